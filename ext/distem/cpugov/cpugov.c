@@ -1,7 +1,9 @@
 #include <ruby.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include "cpugov.h"
 #include "main.h"
@@ -9,16 +11,122 @@
 static VALUE m_cpu;
 static VALUE c_cpugov;
 
+/* There is only one governor process per physical node, every CPUGov object
+ * registers its vnode to it */
+static int gov_sock = -1;
+static int gov_pid = 0;
+static unsigned int gov_users = 0;
+static int gov_ids = 0;
 
-int cores[MAX_CORES];
-unsigned int corenb;
-int freq_max;
+static void governor_start()
+{
+  int pid;
+  int sv[2];
+
+  if (socketpair(AF_UNIX,SOCK_SEQPACKET,0,sv) < 0)
+    rb_sys_fail("socketpair");
 
-__inline__ static VALUE cpugov_parse_core(VALUE coreid)
+  pid = fork();
+  if (pid < 0)
+  {
+    close(sv[0]);
+    close(sv[1]);
+    rb_raise(rb_eRuntimeError,"fork");
+  }
+  if (!pid)
+    {
+      if (setsid() < 0)
+        exit(1);
+      close(STDIN_FILENO);
+      close(STDOUT_FILENO);
+      close(STDERR_FILENO);
+      close(sv[0]);
+
+      exit(governor_run(sv[1]));
+    }
+
+  close(sv[1]);
+  gov_sock = sv[0];
+  gov_pid = pid;
+}
+
+static void governor_stop()
 {
-  cores[corenb++] = NUM2INT(coreid);
+  close(gov_sock);
+  waitpid(gov_pid,NULL,0);
+  gov_sock = -1;
+  gov_pid = 0;
+}
 
-  return Qnil;
+/* Ask the governor to exit and wait for it */
+static void governor_quit(void)
+{
+  gov_cmd cmd;
+  gov_reply reply;
+
+  memset(&cmd,0,sizeof(cmd));
+  cmd.op = GOV_QUIT;
+  if (send(gov_sock,&cmd,sizeof(cmd),MSG_NOSIGNAL) == (ssize_t)sizeof(cmd))
+    recv(gov_sock,&reply,sizeof(reply),0);
+  governor_stop();
+}
+
+/* Send a request (and free it), returns the status of the reply */
+static int governor_request(gov_cmd *cmd, size_t size, gov_reply *reply)
+{
+  if (send(gov_sock,cmd,size,MSG_NOSIGNAL) != (ssize_t)size
+    || recv(gov_sock,reply,sizeof(*reply),0) != sizeof(*reply))
+  {
+    xfree(cmd);
+    governor_stop();
+    gov_users = 0;
+    rb_raise(rb_eRuntimeError,"The CPU governor is not responding");
+  }
+  xfree(cmd);
+
+  return reply->status;
+}
+
+static void check_status(int status)
+{
+  if (status)
+    rb_raise(rb_eRuntimeError,"CPU governor: %s",strerror(status));
+}
+
+static gov_cmd *cpugov_build_cmd(
+  VALUE self,
+  int op,
+  VALUE low_freq,
+  VALUE high_freq,
+  VALUE low_rate,
+  size_t *size
+)
+{
+  gov_cmd *cmd;
+  VALUE cores, tmp;
+  long i;
+
+  cores = rb_iv_get(self,"@cores");
+  tmp = rb_iv_get(self,"@cgrouppath");
+  *size = sizeof(gov_cmd) + sizeof(int) * RARRAY_LEN(cores);
+  cmd = (gov_cmd *) xcalloc(1,*size);
+
+  cmd->op = op;
+  cmd->id = NUM2INT(rb_iv_get(self,"@id"));
+  cmd->pitch = (unsigned long long) (NUM2DBL(rb_iv_get(self, "@pitch")) * 1000000);
+  cmd->freqmax = NUM2INT(rb_iv_get(self,"@freqmax"));
+  if (op == GOV_ADD || op == GOV_UPDATE)
+  {
+    cmd->lowfreq = NUM2UINT(low_freq);
+    cmd->highfreq = NUM2UINT(high_freq);
+    cmd->ratelow = NUM2DBL(low_rate);
+  }
+  snprintf(cmd->cgroup_path,sizeof(cmd->cgroup_path),"%s",StringValueCStr(tmp));
+  cmd->corenb = RARRAY_LEN(cores);
+  for (i = 0; i < RARRAY_LEN(cores); i++)
+    cmd->cores[i] = NUM2INT(rb_ary_entry(cores,i));
+
+  return cmd;
 }
 
 static VALUE cpugov_init(
@@ -32,10 +140,9 @@ static VALUE cpugov_init(
 	rb_iv_set(self, "@cores", rb_ary_dup(cores));
 	rb_iv_set(self, "@freqmax", freqmax);
 	rb_iv_set(self, "@pid", INT2NUM(0));
+	rb_iv_set(self, "@id", INT2NUM(++gov_ids));
 	rb_iv_set(self, "@cgrouppath", rb_str_dup(cgroup_path));
 
-  freq_max = freqmax;
-
 	return self;
 }
 
@@ -46,46 +153,104 @@ static VALUE cpugov_run(
   VALUE low_rate
 )
 {
+  gov_cmd *cmd;
+  gov_reply reply;
+  size_t size;
+  int status;
+
+  if (NUM2INT(rb_iv_get(self, "@pid")))
+    rb_raise(rb_eRuntimeError,"Already running");
+
+  cmd = cpugov_build_cmd(self,GOV_ADD,low_freq,high_freq,low_rate,&size);
+  if (!gov_pid)
+    governor_start();
+  status = governor_request(cmd,size,&reply);
+
+  if (!status)
+  {
+    gov_users++;
+    rb_iv_set(self, "@pid", INT2NUM(gov_pid));
+  }
+  /* the governor was started for this vnode */
+  else if (!gov_users)
+    governor_quit();
+  check_status(status);
+
+  return Qnil;
+}
+
+/* Change the frequencies of a running vnode without restarting anything */
+static VALUE cpugov_update(
+  VALUE self,
+  VALUE low_freq,
+  VALUE high_freq,
+  VALUE low_rate
+)
+{
+  gov_cmd *cmd;
+  gov_reply reply;
+  size_t size;
+
+  if (!NUM2INT(rb_iv_get(self, "@pid")))
+    rb_raise(rb_eRuntimeError,"Not running");
+
+  cmd = cpugov_build_cmd(self,GOV_UPDATE,low_freq,high_freq,low_rate,&size);
+  check_status(governor_request(cmd,size,&reply));
+
+  return Qnil;
+}
+
+static VALUE cpugov_stop(VALUE self)
+{
+  gov_cmd *cmd;
+  gov_reply reply;
+  size_t size;
+  int status;
   int pid;
 
-  pid = fork();
-  if (pid < 0)
-    rb_raise(rb_eRuntimeError,"fork");
+  pid = NUM2INT(rb_iv_get(self, "@pid"));
   if (!pid)
-    {
-      if (setsid() < 0)
-	rb_raise(rb_eRuntimeError,"setsid");
-      close(STDIN_FILENO);
-      close(STDOUT_FILENO);
-      close(STDERR_FILENO);
+    return Qnil;
+  rb_iv_set(self, "@pid", INT2NUM(0));
 
-      rb_iterate(rb_each, rb_iv_get(self,"@cores"), cpugov_parse_core, Qnil);
+  /* the governor died since this vnode was registered */
+  if (pid != gov_pid)
+    return Qnil;
 
-      VALUE tmp = rb_iv_get(self,"@cgrouppath");
-      extrun(
-	     (unsigned long long) (NUM2DBL(rb_iv_get(self, "@pitch")) * 1000000),
-	     NUM2INT(low_freq),NUM2INT(high_freq),NUM2DBL(low_rate),
-	     StringValueCStr(tmp)
-	     );
-      exit(0);
-    }
-  else
-    rb_iv_set(self, "@pid", INT2NUM(pid));
+  cmd = cpugov_build_cmd(self,GOV_REMOVE,Qnil,Qnil,Qnil,&size);
+  status = governor_request(cmd,size,&reply);
+
+  /* the vnode is not handled anymore even if the governor failed to remove it */
+  if (!--gov_users)
+    governor_quit();
+  check_status(status);
 
   return Qnil;
 }
 
-static VALUE cpugov_stop(VALUE self)
+/* Returns the number of transitions performed for this vnode and the time
+ * spent in them (in seconds) */
+static VALUE cpugov_stats(VALUE self)
 {
-	int pid;
+  gov_cmd *cmd;
+  gov_reply reply;
+  size_t size;
+  VALUE stats;
 
-	pid = NUM2INT(rb_iv_get(self, "@pid"));
-	kill(pid,SIGKILL);
-  waitpid(pid,NULL,0);
+  stats = rb_hash_new();
+  if (!NUM2INT(rb_iv_get(self, "@pid")))
+    return stats;
 
-	rb_iv_set(self, "@pid", INT2NUM(0));
+  cmd = cpugov_build_cmd(self,GOV_STATS,Qnil,Qnil,Qnil,&size);
+  check_status(governor_request(cmd,size,&reply));
+
+  rb_hash_aset(stats,rb_str_new2("transitions"),ULL2NUM(reply.transitions));
+  rb_hash_aset(stats,rb_str_new2("transition_time"),
+    rb_float_new(reply.transition_time / 1e9));
+  rb_hash_aset(stats,rb_str_new2("transition_max"),
+    rb_float_new(reply.transition_max / 1e9));
 
-	return Qnil;
+  return stats;
 }
 
 static VALUE cpugov_is_run(VALUE self)
@@ -107,6 +272,8 @@ void Init_cpugov()
 	rb_define_attr(c_cpugov, "freqmax", 1, 0);
 	rb_define_attr(c_cpugov, "cgrouppath", 1, 0);
 	rb_define_method(c_cpugov, "run", cpugov_run, 3);
+	rb_define_method(c_cpugov, "update", cpugov_update, 3);
+	rb_define_method(c_cpugov, "stats", cpugov_stats, 0);
 	rb_define_method(c_cpugov, "stop", cpugov_stop, 0);
 	rb_define_method(c_cpugov, "running?", cpugov_is_run, 0);
 }
@@ -2,12 +2,37 @@
 #define _CPUGOV_H
 
 #define STRBUFF_SIZE 128
+#define PATHBUFF_SIZE 512
 
 #define DEFAULT_PITCH 0.1f /* default pitch (in seconds) */
-#define MAX_CORES 128
 
-extern int cores[];
-extern unsigned int corenb;
-extern int freq_max;
+/* Commands sent to the governor process (one message per command on a
+ * SOCK_SEQPACKET socket, the governor answers with a gov_reply) */
+#define GOV_ADD 1
+#define GOV_UPDATE 2
+#define GOV_REMOVE 3
+#define GOV_QUIT 4
+#define GOV_STATS 5
+
+typedef struct {
+  int op;
+  int id; /* vnode identifier */
+  unsigned long long pitch; /* in us */
+  unsigned int lowfreq;
+  unsigned int highfreq;
+  double ratelow;
+  int freqmax;
+  char cgroup_path[PATHBUFF_SIZE];
+  unsigned int corenb;
+  int cores[]; /* corenb physical core ids */
+} gov_cmd;
+
+typedef struct {
+  int status; /* 0 or errno */
+  /* time spent writing to sysfs/cgroupfs for the transitions of the vnode */
+  unsigned long long transitions;
+  unsigned long long transition_time; /* in ns */
+  unsigned long long transition_max; /* in ns */
+} gov_reply;
 
 #endif
@@ -3,173 +3,465 @@
 #include <stdio.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
 #include "cpugov.h"
 #include "main.h"
+#include "sysfs.h"
+
+/*
+ * The governor handles the frequency of the cores of every vnode of the
+ * physical node from a single event loop. Each vnode that has to switch
+ * between two frequencies has an absolute deadline for its next transition,
+ * the timerfd is always armed on the earliest one.
+ */
+
+#define MODE_HIGH 0 /* always at the high frequency */
+#define MODE_LOW 1 /* always at the low frequency (or frozen) */
+#define MODE_CYCLE 2 /* switching between both */
+
+typedef struct vnode {
+  int id;
+  unsigned int corenb;
+  int *cores;
+  int *corefds;
+  int freqmax;
+  unsigned int lowfreq, highfreq;
+  char lowfreqstr[STRBUFF_SIZE], highfreqstr[STRBUFF_SIZE];
+  unsigned int lowfreqstr_size, highfreqstr_size;
+  unsigned long long lowtime, hightime; /* in ns */
+  char cgroup_path[PATHBUFF_SIZE];
+  sysfs_freezer freezer;
+  int frozen;
+  int mode;
+  int low; /* currently in the low phase */
+  struct timespec deadline;
+  unsigned long long transitions;
+  unsigned long long transition_time, transition_max;
+  struct vnode *next;
+} vnode;
+
+static vnode *vnodes = NULL;
+static volatile sig_atomic_t finished = 0;
+
+static inline void ts_add(struct timespec *ts, unsigned long long ns)
+{
+  ns += ts->tv_nsec;
+  ts->tv_sec += ns / 1000000000ULL;
+  ts->tv_nsec = ns % 1000000000ULL;
+}
+
+static inline int ts_cmp(const struct timespec *a, const struct timespec *b)
+{
+  if (a->tv_sec != b->tv_sec)
+    return (a->tv_sec < b->tv_sec ? -1 : 1);
+  if (a->tv_nsec != b->tv_nsec)
+    return (a->tv_nsec < b->tv_nsec ? -1 : 1);
+  return 0;
+}
+
+static inline unsigned long long ts_diff(const struct timespec *a, const struct timespec *b)
+{
+  return (a->tv_sec - b->tv_sec) * 1000000000ULL + a->tv_nsec - b->tv_nsec;
+}
+
+static int write_cores(vnode *v, const char *str, unsigned int size)
+{
+  unsigned int corei;
 
-unsigned int lowfreq, highfreq;
-unsigned long long int lowtime, hightime;
-static char lowfreqstr[STRBUFF_SIZE], highfreqstr[STRBUFF_SIZE];
-static unsigned int lowfreqstr_size, highfreqstr_size;
-static int corefds[MAX_CORES];
-static int cgroupfreezefd;
-unsigned int finished = 0;
+  corei = v->corenb;
+  while (corei--)
+    if (v->corefds[corei] >= 0 && sysfs_write(v->corefds[corei],str,size))
+      return -1;
+  return 0;
+}
 
-#define DO_NOTHING() \
-while(!finished) \
-  sleep(2);
+static inline int set_frequency_low(vnode *v)
+{
+  return write_cores(v,v->lowfreqstr,v->lowfreqstr_size);
+}
 
+static inline int set_frequency_high(vnode *v)
+{
+  return write_cores(v,v->highfreqstr,v->highfreqstr_size);
+}
 
-__inline__ void set_frequency_low()
+static void reset_frequency(vnode *v)
 {
-  static unsigned int corei;
+  char strbuff[STRBUFF_SIZE];
+  unsigned int size;
 
-  corei = corenb;
+  size = snprintf(strbuff,sizeof(strbuff),"%d",v->freqmax);
+  if (write_cores(v,strbuff,size))
+    perror(__func__);
+}
 
-  while (corei--)
-    if (write(corefds[corei],lowfreqstr,lowfreqstr_size) <= 0)
-      exit(1);
+static int cgroup_freeze(vnode *v)
+{
+  if (v->freezer.fd < 0 || sysfs_freezer_set(&v->freezer,1))
+  {
+    perror(__func__);
+    return -1;
+  }
+  v->frozen = 1;
+  return 0;
 }
 
-__inline__ void set_frequency_high()
+static int cgroup_thaw(vnode *v)
 {
-  static unsigned int corei;
+  if (v->freezer.fd < 0 || sysfs_freezer_set(&v->freezer,0))
+  {
+    perror(__func__);
+    return -1;
+  }
+  v->frozen = 0;
+  return 0;
+}
 
-  corei = corenb;
+static int enter_low(vnode *v)
+{
+  v->low = 1;
+  if (v->lowfreq == 0)
+    return cgroup_freeze(v);
+  /* frozen by a previous configuration without low frequency */
+  if (v->frozen && cgroup_thaw(v))
+    return -1;
+  return set_frequency_low(v);
+}
 
-  while (corei--)
-    if (write(corefds[corei],highfreqstr,highfreqstr_size) <= 0)
-      exit(1);
+static int enter_high(vnode *v)
+{
+  v->low = 0;
+  if (v->frozen && cgroup_thaw(v))
+    return -1;
+  return set_frequency_high(v);
 }
 
-__inline__ void set_frequency(unsigned int frequency)
+/* Perform a transition, keeping track of the time it took */
+static int transition(vnode *v, int low)
 {
-  unsigned int corei, strbuff_size;
-  char strbuff[STRBUFF_SIZE];
+  int ret;
+  unsigned long long time;
+  struct timespec start, end;
 
-  strbuff_size = snprintf(strbuff,sizeof(strbuff),"%d",frequency);
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  ret = (low ? enter_low(v) : enter_high(v));
+  clock_gettime(CLOCK_MONOTONIC,&end);
 
-  corei = corenb;
+  time = ts_diff(&end,&start);
+  v->transitions++;
+  v->transition_time += time;
+  if (time > v->transition_max)
+    v->transition_max = time;
 
-  while (corei--)
-    if (write(corefds[corei],strbuff,strbuff_size) <= 0)
-      exit(1);
+  return ret;
 }
 
-__inline__ void reset_frequency()
+static vnode *vnode_find(int id)
 {
-  char filenamebuff[STRBUFF_SIZE];
-  unsigned int tmp;
+  vnode *v;
 
-  tmp = corenb;
+  for (v = vnodes; v; v = v->next)
+    if (v->id == id)
+      return v;
+  return NULL;
+}
 
-  while (tmp--)
+/* (Re)Compute the cycle of a vnode, the first transition is performed now */
+static int vnode_configure(vnode *v, gov_cmd *cmd)
+{
+  unsigned long long pitch = cmd->pitch * 1000ULL;
+
+  v->lowfreq = cmd->lowfreq;
+  v->lowfreqstr_size = snprintf(v->lowfreqstr,sizeof(v->lowfreqstr),"%u",v->lowfreq);
+  v->highfreq = cmd->highfreq;
+  v->highfreqstr_size = snprintf(v->highfreqstr,sizeof(v->highfreqstr),"%u",v->highfreq);
+
+  if (cmd->ratelow == 0.0f)
+    v->mode = MODE_HIGH;
+  else if (cmd->ratelow == 1.0f)
+    v->mode = MODE_LOW;
+  else
   {
-    snprintf(filenamebuff,sizeof(filenamebuff),
-      "cpufreq-set -c %d -f %d",cores[tmp],freq_max);
-    if (system(filenamebuff) == -1)
-      exit(1);
+    v->mode = MODE_CYCLE;
+    v->lowtime = (__typeof__(v->lowtime)) (pitch * cmd->ratelow);
+    v->hightime = (__typeof__(v->hightime)) (pitch * (1-cmd->ratelow));
   }
-}
 
-__inline__ void cgroup_freeze()
-{
-  if (write(cgroupfreezefd,CGROUP_FREEZE,sizeof(CGROUP_FREEZE)) <= 0)
+  if (v->lowfreq == 0 && v->mode != MODE_HIGH && v->freezer.fd < 0)
   {
-        perror(__func__);
-        exit(1);
+    if (sysfs_freezer_open(&v->freezer,v->cgroup_path))
+    {
+      perror(v->cgroup_path);
+      return -1;
+    }
   }
-}
 
-__inline__ void cgroup_thaw()
-{
-  if (write(cgroupfreezefd,CGROUP_THAW,sizeof(CGROUP_THAW)) <= 0)
+  printf("vnode %d: pitch: %lluus, freqlow: %u kHz, freqhigh: %u KHz, timelow: %lluns, timehigh: %lluns\n",v->id,cmd->pitch,v->lowfreq,v->highfreq,v->lowtime,v->hightime);
+
+  switch (v->mode)
   {
-        perror(__func__);
-        exit(1);
+    case MODE_HIGH:
+      return transition(v,0);
+    case MODE_LOW:
+      return transition(v,1);
+    default:
+      clock_gettime(CLOCK_MONOTONIC,&v->deadline);
+      ts_add(&v->deadline,v->lowtime);
+      return transition(v,1);
   }
 }
 
-/* Using of cores and corenb global var (see cpugov.h) */
-void init_cores()
+static void vnode_free(vnode *v)
 {
   unsigned int tmp;
-  char filenamebuff[STRBUFF_SIZE];
 
-  tmp = corenb;
+  if (v->frozen)
+    cgroup_thaw(v);
+  reset_frequency(v);
+  sysfs_freezer_close(&v->freezer);
+  tmp = v->corenb;
+  while (tmp--)
+    if (v->corefds[tmp] >= 0)
+      close(v->corefds[tmp]);
+  free(v->cores);
+  free(v->corefds);
+  free(v);
+}
+
+static int vnode_add(gov_cmd *cmd)
+{
+  unsigned int tmp;
+  int fd;
+  vnode *v;
+
+  if (vnode_find(cmd->id))
+    return EEXIST;
+
+  v = calloc(1,sizeof(vnode));
+  if (!v)
+    return ENOMEM;
+  v->id = cmd->id;
+  v->corenb = cmd->corenb;
+  v->freqmax = cmd->freqmax;
+  v->freezer.fd = -1;
+  v->cores = malloc(sizeof(int) * v->corenb);
+  v->corefds = malloc(sizeof(int) * v->corenb);
+  if (!v->cores || !v->corefds)
+  {
+    free(v->cores);
+    free(v->corefds);
+    free(v);
+    return ENOMEM;
+  }
+  memcpy(v->cores,cmd->cores,sizeof(int) * v->corenb);
+  snprintf(v->cgroup_path,sizeof(v->cgroup_path),"%s",cmd->cgroup_path);
 
+  /* equivalent of cpufreq-set -f: switch to the userspace governor */
+  tmp = v->corenb;
   while (tmp--)
   {
-    snprintf(filenamebuff,sizeof(filenamebuff),
-      "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_setspeed",cores[tmp]);
-    corefds[tmp] = open(filenamebuff,O_WRONLY);
+    fd = sysfs_open(
+      "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",v->cores[tmp]);
+    if (fd >= 0)
+    {
+      if (sysfs_write_str(fd,"userspace"))
+        perror(__func__);
+      close(fd);
+    }
+    v->corefds[tmp] = sysfs_open(
+      "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_setspeed",v->cores[tmp]);
+  }
+  reset_frequency(v);
+
+  if (vnode_configure(v,cmd))
+  {
+    vnode_free(v);
+    return EIO;
   }
-  reset_frequency();
+  v->next = vnodes;
+  vnodes = v;
+  return 0;
 }
 
-void cycle()
+static int vnode_remove(int id)
 {
-  if (lowfreq == 0)
-    cgroup_freeze();
-  else
-    set_frequency_low();
+  vnode **prev, *v;
 
-  usleep(lowtime);
+  for (prev = &vnodes; (v = *prev); prev = &v->next)
+  {
+    if (v->id == id)
+    {
+      *prev = v->next;
+      vnode_free(v);
+      return 0;
+    }
+  }
+  return ENOENT;
+}
 
-  if (lowfreq == 0)
-    cgroup_thaw();
-  else
-    set_frequency_high();
+static int handle_command(gov_cmd *cmd, gov_reply *reply)
+{
+  vnode *v;
 
-  usleep(hightime);
+  switch (cmd->op)
+  {
+    case GOV_STATS:
+      if (!(v = vnode_find(cmd->id)))
+        return ENOENT;
+      reply->transitions = v->transitions;
+      reply->transition_time = v->transition_time;
+      reply->transition_max = v->transition_max;
+      return 0;
+    case GOV_ADD:
+      return vnode_add(cmd);
+    case GOV_UPDATE:
+      if (!(v = vnode_find(cmd->id)))
+        return ENOENT;
+      return (vnode_configure(v,cmd) ? EIO : 0);
+    case GOV_REMOVE:
+      return vnode_remove(cmd->id);
+    case GOV_QUIT:
+      finished = 1;
+      return 0;
+    default:
+      return EINVAL;
+  }
 }
 
-void stop(int num)
+/* Perform every transition that is due and arm the timer on the next one */
+static void schedule(int timerfd)
 {
-  int tmp;
+  struct timespec now;
+  struct itimerspec its;
+  vnode *v, *next = NULL;
 
-  tmp = corenb;
-  while (tmp--)
-    close(corefds[tmp]);
-  close(cgroupfreezefd);
-  reset_frequency();
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  for (v = vnodes; v; v = v->next)
+  {
+    if (v->mode != MODE_CYCLE)
+      continue;
+
+    if (ts_cmp(&v->deadline,&now) <= 0)
+    {
+      if (v->low)
+      {
+        transition(v,0);
+        ts_add(&v->deadline,v->hightime);
+      }
+      else
+      {
+        transition(v,1);
+        ts_add(&v->deadline,v->lowtime);
+      }
+      /* we are late of more than one phase, do not try to catch up */
+      if (ts_cmp(&v->deadline,&now) <= 0)
+      {
+        v->deadline = now;
+        ts_add(&v->deadline,(v->low ? v->lowtime : v->hightime));
+      }
+    }
+
+    if (!next || ts_cmp(&v->deadline,&next->deadline) < 0)
+      next = v;
+  }
+
+  memset(&its,0,sizeof(its));
+  if (next)
+    its.it_value = next->deadline;
+  timerfd_settime(timerfd,TFD_TIMER_ABSTIME,&its,NULL);
+}
+
+static void stop(int num)
+{
   finished = 1;
 }
 
-int extrun(unsigned long long pitch, unsigned int freqlow, unsigned int freqhigh, double ratelow, char *cgroup_path)
+int governor_run(int sock)
 {
-  char strbuff[STRBUFF_SIZE];
+  int timerfd;
+  gov_reply reply;
+  ssize_t size;
+  gov_cmd *cmd;
+  size_t cmdsize;
+  uint64_t expirations;
+  struct pollfd fds[2];
 
   if (signal(SIGINT, stop) == SIG_ERR || signal(SIGTERM, stop) == SIG_ERR)
     return 1;
-  init_cores();
-  lowfreq = freqlow;
-  lowfreqstr_size = snprintf(lowfreqstr,sizeof(lowfreqstr),"%d",lowfreq);
-  highfreq = freqhigh;
-  highfreqstr_size = snprintf(highfreqstr,sizeof(highfreqstr),"%d",highfreq);
 
-  if (ratelow == 0.0f)
-  {
-    set_frequency_high();
-    DO_NOTHING();
-  }
-  else if (ratelow == 1.0f)
-  {
-    set_frequency_low();
-    DO_NOTHING();
-  }
-  else
-  {
-    lowtime = (__typeof__(lowtime)) (pitch * ratelow);
-    hightime = (__typeof__(hightime)) (pitch * (1-ratelow));
+  timerfd = timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC);
+  if (timerfd < 0)
+    return 1;
 
-    snprintf(strbuff,sizeof(strbuff),"%s/freezer.state",cgroup_path);
-    cgroupfreezefd = open(strbuff,O_WRONLY);
+  cmdsize = sizeof(gov_cmd) + sizeof(int) * STRBUFF_SIZE;
+  cmd = malloc(cmdsize);
+  if (!cmd)
+    return 1;
 
-    printf("pitch: %lluus, freqlow: %u kHz, freqhigh: %u KHz, timelow: %lluus, timehigh: %lluus\n",pitch,lowfreq,highfreq,lowtime,hightime);
+  fds[0].fd = sock;
+  fds[0].events = POLLIN;
+  fds[1].fd = timerfd;
+  fds[1].events = POLLIN;
 
-    set_frequency_high();
-    while (!finished)
-      cycle();
+  while (!finished)
+  {
+    if (poll(fds,2,-1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[1].revents & POLLIN)
+    {
+      if (read(timerfd,&expirations,sizeof(expirations)) < 0 && errno != EAGAIN)
+        break;
+      schedule(timerfd);
+    }
+
+    if (fds[0].revents & (POLLHUP | POLLERR))
+      break;
+
+    if (fds[0].revents & POLLIN)
+    {
+      /* get the size of the message to be able to handle any number of cores */
+      size = recv(sock,NULL,0,MSG_PEEK | MSG_TRUNC);
+      if (size <= 0)
+        break;
+      if ((size_t)size > cmdsize)
+      {
+        free(cmd);
+        cmdsize = size;
+        cmd = malloc(cmdsize);
+        if (!cmd)
+          break;
+      }
+      size = recv(sock,cmd,cmdsize,0);
+      if (size <= 0)
+        break;
+
+      memset(&reply,0,sizeof(reply));
+      if ((size_t)size < sizeof(gov_cmd)
+        || (size_t)size < sizeof(gov_cmd) + sizeof(int) * cmd->corenb)
+        reply.status = EINVAL;
+      else
+        reply.status = handle_command(cmd,&reply);
+
+      if (send(sock,&reply,sizeof(reply),MSG_NOSIGNAL) != sizeof(reply))
+        break;
+      schedule(timerfd);
+    }
   }
+
+  while (vnodes)
+    vnode_remove(vnodes->id);
+  free(cmd);
+  close(timerfd);
   return 0;
 }
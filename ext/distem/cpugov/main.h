@@ -1,9 +1,6 @@
 #ifndef _MAIN_H
 #define _MAIN_H
 
-int extrun(unsigned long long pitch, unsigned int freqlow, unsigned int freqhigh, double ratelow, char *cgroup_path);
-
-#define CGROUP_FREEZE "FROZEN"
-#define CGROUP_THAW "THAWED"
+int governor_run(int sock);
 
 #endif
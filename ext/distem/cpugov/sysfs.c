@@ -0,0 +1,64 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "cpugov.h"
+#include "sysfs.h"
+
+int sysfs_open(const char *fmt, ...)
+{
+  char path[PATHBUFF_SIZE + STRBUFF_SIZE];
+  va_list ap;
+
+  va_start(ap,fmt);
+  vsnprintf(path,sizeof(path),fmt,ap);
+  va_end(ap);
+
+  return open(path,O_WRONLY | O_CLOEXEC);
+}
+
+int sysfs_write(int fd, const char *buf, size_t size)
+{
+  ssize_t ret;
+
+  do
+    ret = pwrite(fd,buf,size,0);
+  while (ret < 0 && errno == EINTR);
+
+  return (ret == (ssize_t)size ? 0 : -1);
+}
+
+int sysfs_write_str(int fd, const char *str)
+{
+  return sysfs_write(fd,str,strlen(str));
+}
+
+/* Use the cgroup v2 freezer if the cgroup is on the unified hierarchy */
+int sysfs_freezer_open(sysfs_freezer *freezer, const char *cgroup_path)
+{
+  freezer->v2 = 1;
+  freezer->fd = sysfs_open("%s/cgroup.freeze",cgroup_path);
+  if (freezer->fd < 0 && errno == ENOENT)
+  {
+    freezer->v2 = 0;
+    freezer->fd = sysfs_open("%s/freezer.state",cgroup_path);
+  }
+  return (freezer->fd < 0 ? -1 : 0);
+}
+
+int sysfs_freezer_set(sysfs_freezer *freezer, int frozen)
+{
+  if (freezer->v2)
+    return sysfs_write_str(freezer->fd,(frozen ? CGROUP2_FREEZE : CGROUP2_THAW));
+  else
+    return sysfs_write_str(freezer->fd,(frozen ? CGROUP_FREEZE : CGROUP_THAW));
+}
+
+void sysfs_freezer_close(sysfs_freezer *freezer)
+{
+  if (freezer->fd >= 0)
+    close(freezer->fd);
+  freezer->fd = -1;
+}
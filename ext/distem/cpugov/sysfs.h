@@ -0,0 +1,30 @@
+#ifndef _SYSFS_H
+#define _SYSFS_H
+
+#include <stddef.h>
+
+/*
+ * Minimal writer for the sysfs and cgroupfs attributes used by the
+ * governor. The files are opened once and kept open, every write is a
+ * single pwrite() at the beginning of the attribute.
+ */
+
+#define CGROUP_FREEZE "FROZEN"
+#define CGROUP_THAW "THAWED"
+#define CGROUP2_FREEZE "1"
+#define CGROUP2_THAW "0"
+
+typedef struct {
+  int fd;
+  int v2; /* cgroup.freeze (v2) or freezer.state (v1) */
+} sysfs_freezer;
+
+int sysfs_open(const char *fmt, ...);
+int sysfs_write(int fd, const char *buf, size_t size);
+int sysfs_write_str(int fd, const char *str);
+
+int sysfs_freezer_open(sysfs_freezer *freezer, const char *cgroup_path);
+int sysfs_freezer_set(sysfs_freezer *freezer, int frozen);
+void sysfs_freezer_close(sysfs_freezer *freezer);
+
+#endif
@@ -1,38 +1,117 @@
 #include <ruby.h>
 #include <signal.h>
 #include <unistd.h>
-#include <st.h>
+#include <ruby/st.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include "main.h"
 
-#define MAX_CPUS 128
-
 static VALUE m_cpu;
 static VALUE c_cpuhogs;
-cpu_cmds *cmds;
+
+static void cpuhogs_free(void *ptr)
+{
+	munmap(ptr, sizeof(cpu_cmds));
+}
+
+static size_t cpuhogs_memsize(const void *ptr)
+{
+	return sizeof(cpu_cmds);
+}
+
+static const rb_data_type_t cpuhogs_type = {
+	"CPUExtension::CPUHogs",
+	{ 0, cpuhogs_free, cpuhogs_memsize, },
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static cpu_cmds *get_cmds(VALUE self)
+{
+	cpu_cmds *cmds;
+	TypedData_Get_Struct(self, cpu_cmds, &cpuhogs_type, cmds);
+	return cmds;
+}
+
+/* The commands are stored in an anonymous shared mapping so that they are
+ * still reachable from the Ruby process after the hog process was forked */
+static VALUE cpuhogs_alloc(VALUE klass)
+{
+	cpu_cmds *cmds;
+
+	cmds = mmap(NULL, sizeof(cpu_cmds), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (cmds == MAP_FAILED)
+		rb_raise(rb_eNoMemError, "mmap");
+
+	return TypedData_Wrap_Struct(klass, &cpuhogs_type, cmds);
+}
 
 static VALUE cpuhogs_init(VALUE self)
 {
+	cpu_cmds *cmds = get_cmds(self);
+
 	rb_iv_set(self, "@pid", INT2NUM(0));
-	cmds = ALLOC(cpu_cmds);
+	rb_iv_set(self, "@feedback", Qfalse);
 	cmds->cpufreq = 1;
+	cmds->feedback = 0;
 	cmds->interval = 10000000;
 	cmds->cpus = 0;
 
 	return self;
 }
 
-int parse_hash(VALUE key, VALUE val, VALUE in)
+static int parse_hash(VALUE key, VALUE val, VALUE in)
 {
+	cpu_cmds *cmds = (cpu_cmds *) in;
+
+	if (cmds->cpus >= MAX_CPUS)
+		rb_raise(rb_eArgError, "Too many CPUs (max %d)", MAX_CPUS);
 	cmds->ratios[cmds->cpus].cpu = NUM2INT(key);
 	cmds->ratios[cmds->cpus].ratio = (float) NUM2DBL(val);
+	cmds->ratios[cmds->cpus].achieved = 1.0f;
 	cmds->cpus++;
 	return ST_CONTINUE;
 }
 
+static int find_cpu(cpu_cmds *cmds, int cpu)
+{
+	int i;
+
+	for (i = 0; i < cmds->cpus; i++)
+		if (cmds->ratios[i].cpu == cpu)
+			return i;
+	return -1;
+}
+
+static int check_hash(VALUE key, VALUE val, VALUE in)
+{
+	cpu_cmds *cmds = (cpu_cmds *) in;
+
+	if (find_cpu(cmds, NUM2INT(key)) < 0)
+		rb_raise(rb_eArgError, "CPU %d is not handled by this process",
+			NUM2INT(key));
+	NUM2DBL(val);
+	return ST_CONTINUE;
+}
+
+static int update_hash(VALUE key, VALUE val, VALUE in)
+{
+	cpu_cmds *cmds = (cpu_cmds *) in;
+
+	cmds->ratios[find_cpu(cmds, NUM2INT(key))].ratio = (float) NUM2DBL(val);
+	return ST_CONTINUE;
+}
+
 static VALUE cpuhogs_run(VALUE self, VALUE hash)
 {
 	int pid;
+	cpu_cmds *cmds = get_cmds(self);
+
+	Check_Type(hash, T_HASH);
+	cmds->feedback = RTEST(rb_iv_get(self, "@feedback"));
+	cmds->cpus = 0;
+	rb_hash_foreach(hash, parse_hash, (VALUE) cmds);
 
 	pid = fork();
 	if (pid < 0)
@@ -40,31 +119,64 @@ static VALUE cpuhogs_run(VALUE self, VALUE hash)
 	if (!pid)
 	{
 		if (setsid() < 0)
-			rb_raise(rb_eRuntimeError,"setsid");
+			exit(1);
 		close(STDIN_FILENO);
 		close(STDOUT_FILENO);
 		close(STDERR_FILENO);
 
-		cmds->ratios = ALLOC_N(cpu_ratio,MAX_CPUS);
-
-		rb_hash_foreach(hash,parse_hash,Qnil);
-
 		run(cmds);
-                exit(0);
+		exit(0);
 	}
 	else
-  {
+	{
 		rb_iv_set(self, "@pid", INT2NUM(pid));
-  }
+	}
+	return Qnil;
+}
+
+/* Change the ratio of some of the CPUs handled by the running process, the
+ * new values are taken into account by the hog threads at the next interval */
+static VALUE cpuhogs_update(VALUE self, VALUE hash)
+{
+	cpu_cmds *cmds = get_cmds(self);
+
+	Check_Type(hash, T_HASH);
+	rb_hash_foreach(hash, check_hash, (VALUE) cmds);
+	rb_hash_foreach(hash, update_hash, (VALUE) cmds);
+
 	return Qnil;
 }
 
+/* Returns the requested and the measured (achieved) ratio of every CPU */
+static VALUE cpuhogs_stats(VALUE self)
+{
+	int i;
+	VALUE stats, stat;
+	cpu_cmds *cmds = get_cmds(self);
+
+	stats = rb_hash_new();
+	if (!NUM2INT(rb_iv_get(self, "@pid")))
+		return stats;
+
+	for (i = 0; i < cmds->cpus; i++)
+	{
+		stat = rb_hash_new();
+		rb_hash_aset(stat, rb_str_new2("requested"),
+			rb_float_new(cmds->ratios[i].ratio));
+		rb_hash_aset(stat, rb_str_new2("achieved"),
+			rb_float_new(cmds->ratios[i].achieved));
+		rb_hash_aset(stats, INT2NUM(cmds->ratios[i].cpu), stat);
+	}
+
+	return stats;
+}
+
 static VALUE cpuhogs_stop(VALUE self)
 {
 	int pid;
 	pid = NUM2INT(rb_iv_get(self, "@pid"));
 	kill(pid,SIGKILL);
-  waitpid(pid,NULL,0);
+	waitpid(pid,NULL,0);
 	rb_iv_set(self, "@pid", INT2NUM(0));
 
 	return Qnil;
@@ -82,9 +194,13 @@ void Init_cpuhogs()
 {
 	m_cpu = rb_define_module("CPUExtension");
 	c_cpuhogs = rb_define_class_under(m_cpu,"CPUHogs",rb_cObject);
+	rb_define_alloc_func(c_cpuhogs, cpuhogs_alloc);
 	rb_define_method(c_cpuhogs, "initialize", cpuhogs_init, 0);
 	rb_define_attr(c_cpuhogs, "pid", 1, 0);
+	rb_define_attr(c_cpuhogs, "feedback", 1, 1);
 	rb_define_method(c_cpuhogs, "run", cpuhogs_run, 1);
+	rb_define_method(c_cpuhogs, "update", cpuhogs_update, 1);
+	rb_define_method(c_cpuhogs, "stats", cpuhogs_stats, 0);
 	rb_define_method(c_cpuhogs, "stop", cpuhogs_stop, 0);
 	rb_define_method(c_cpuhogs, "running?", cpuhogs_is_run, 0);
 }
@@ -16,8 +16,10 @@
 #include "common.h"
 #include "main.h"
 
-static double ratio;
+/* Minimal ratio a core can be set to (avoids burning for ever) */
+#define MIN_RATIO 0.01
 
+static cpu_cmds* ctrl;
 static pthread_t* threads;
 static pthread_barrier_t barrier;
 static lli loops_per_sec;
@@ -84,16 +86,28 @@ static inline void mysleep(long long int ns) {
 }
 
 void* thread_fn(void* arg) {
-	lli slee, start, end;
-	lli loops_ps = loops_per_sec;
-	double lratio = 1.0 - ratio;
-	double wratio = lratio / (1. - lratio);
+	lli slee, start, end, cycle;
+	double loops_ps = (double)loops_per_sec;
+	double ratio, wratio;
+	double burn, burnt, debt = 0.0, usage;
+	double cpu_start, cpu_burn, cpu_end;
+	double max_debt;
 	lli loops, i;
 	int syncl = sync_barrier;
+	int feedback = ctrl->feedback;
 	int local_finish;
-	long long int interval = *((long long int*)arg);
+	int idx = (int)(long)arg;
+	long long int interval = ctrl->interval;
+
+	max_debt = interval / 1000000000.0;
+	ctrl->ratios[idx].achieved = 1.0;
+
 	while(1)
 	{
+		/* the time spent waiting on the barrier is part of the measured cycle */
+		cycle = GET_TIME();
+		cpu_start = thread_time();
+
 		r_lock();  /* begin reading */
 		if (syncl) {
 			pthread_barrier_wait(&barrier); // this can't fail according to docs
@@ -105,14 +119,54 @@ void* thread_fn(void* arg) {
 			break;
 		}
 
+		/* the ratio can be changed at any time through the control block,
+		 * it is taken into account at the beginning of each interval */
+		ratio = ctrl->ratios[idx].ratio;
+		if (ratio < MIN_RATIO)
+			ratio = MIN_RATIO;
+		if (ratio > 1.0)
+			ratio = 1.0;
+
 		start = GET_TIME();
 		mysleep(interval);
 		end = GET_TIME();
+
+		wratio = (1.0 - ratio) / ratio;
 		slee = end - start;
-		loops = (lli)(loops_ps * slee * wratio / 1000000.0);
+		burn = slee * wratio / 1000000.0;
+		if (feedback)
+			burn += debt;
+		if (burn < 0.0)
+			burn = 0.0;
+
+		loops = (lli)(loops_ps * burn);
+		cpu_burn = thread_time();
 		for (i=0; i < loops; i++) {
 			LOOP();
 		}
+		cpu_end = thread_time();
+		end = GET_TIME();
+
+		usage = (cpu_end - cpu_start) * 1000000.0 / (double)(end - cycle);
+		if (usage > 1.0)
+			usage = 1.0;
+		ctrl->ratios[idx].achieved =
+			0.8 * ctrl->ratios[idx].achieved + 0.2 * (1.0 - usage);
+
+		if (feedback) {
+			/* follow the real speed of the core (turbo, throttling, SMT) */
+			burnt = cpu_end - cpu_burn;
+			if (loops > 0 && burnt > 0.0)
+				loops_ps = 0.5 * loops_ps + 0.5 * ((double)loops / burnt);
+			/* carry the CPU time that was not burnt (or burnt in excess)
+			 * to the next interval */
+			debt += (1.0 - ratio) * (end - cycle) / 1000000.0
+				- (cpu_end - cpu_start);
+			if (debt > max_debt)
+				debt = max_debt;
+			else if (debt < -max_debt)
+				debt = -max_debt;
+		}
 	}
 	return 0;
 }
@@ -122,13 +176,6 @@ void handler(int num) {
 	ctrlc = 1;
 }
 
-static void send_notification() {
-	if (write(3, "!", 1) != 1)
-		printf("Could not send notification!\n");
-	else
-		printf("Notification sent.\n");
-}
-
 #define ERROR(label)  { return_value = 1; goto label; }
 
 int run(cpu_cmds* cmds) {
@@ -154,18 +201,12 @@ int run(cpu_cmds* cmds) {
 
 	sync_barrier = getInteger("sync", 1);  /* sync by default */
 
-	for (i=1; i < cmds->cpus; i++) {
-		if (cmds->ratios[i].ratio != cmds->ratios[0].ratio) {
-			printf("All CPUs must have the same ratio.\n");
-			ERROR(barrier_free);
-		}
-	}
-	
-	ratio = cmds->ratios[0].ratio;
+	ctrl = cmds;
 
 	printf("Syncing: %s\n", (sync_barrier) ? "on" : "off");
 	printf("Interval: %lld\n", cmds->interval);
 	printf("Cpufreq use: %s\n",cmds->cpufreq ? "yes" : "no");
+	printf("Feedback: %s\n",cmds->feedback ? "on" : "off");
 
 	for (i=0; i < cmds->cpus; i++) {
 		printf("CPU %d ratio = %.3f\n", cmds->ratios[i].cpu, cmds->ratios[i].ratio);
@@ -192,7 +233,7 @@ int run(cpu_cmds* cmds) {
 	for (i=0; i < cmds->cpus; i++) {
 		cpu_set_t cpuset;
 		param.sched_priority = sched_get_priority_max(SCHED_FIFO);
-		if (pthread_create(&threads[i], NULL, thread_fn, (void*)&cmds->interval)) {
+		if (pthread_create(&threads[i], NULL, thread_fn, (void*)(long)i)) {
 			printf("Could not start thread.\n");
 			ERROR(threads_free);
 		}
@@ -207,8 +248,6 @@ int run(cpu_cmds* cmds) {
 			ERROR(threads_free);
 		}
 	}
-	
-  //send_notification();
 
 	while (1) {
 		if (ctrlc) {
@@ -221,8 +260,6 @@ int run(cpu_cmds* cmds) {
 		usleep(100000);
 	}
 
-threads_join:
-	
 	for (i=0; i < cmds->cpus; i++) {
 		if (pthread_join(threads[i], NULL)) {
 			printf("Threads could not be joined.\n");
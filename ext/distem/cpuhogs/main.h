@@ -1,16 +1,26 @@
 #ifndef _MAIN_H
 #define _MAIN_H
 
+#define MAX_CPUS 128
+
 	typedef struct {
 		int cpu;
-		float ratio;
+		/* written by the Ruby process, read by the hog threads */
+		volatile float ratio;
+		/* ratio of the core really left to the vnode, measured by the
+		 * hog thread (smoothed over a few intervals) */
+		volatile float achieved;
 	} cpu_ratio;
 
+	/* Control block shared between the Ruby process and the forked hog
+	 * process (see CPUHogs#update) */
 	typedef struct {
 		int cpufreq;
+		/* correct the burn budget according to the measured CPU usage */
+		int feedback;
 		long long int interval;
-		cpu_ratio* ratios;
 		int cpus;
+		cpu_ratio ratios[MAX_CPUS];
 	} cpu_cmds;
 
 	int run(cpu_cmds* cmds);
@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_cls.h>
+#include "edt.h"
+
+/* Instructions (see samples/bpf/bpf_insn.h in the kernel sources) */
+#define INSN(CODE, DST, SRC, OFF, IMM) \
+  ((struct bpf_insn) { .code = (CODE), .dst_reg = (DST), .src_reg = (SRC), \
+    .off = (OFF), .imm = (IMM) })
+#define MOV64_REG(DST, SRC) INSN(BPF_ALU64 | BPF_MOV | BPF_X, DST, SRC, 0, 0)
+#define MOV64_IMM(DST, IMM) INSN(BPF_ALU64 | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define ALU64_REG(OP, DST, SRC) INSN(BPF_ALU64 | (OP) | BPF_X, DST, SRC, 0, 0)
+#define ALU64_IMM(OP, DST, IMM) INSN(BPF_ALU64 | (OP) | BPF_K, DST, 0, 0, IMM)
+#define LDX_MEM(SIZE, DST, SRC, OFF) \
+  INSN(BPF_LDX | (SIZE) | BPF_MEM, DST, SRC, OFF, 0)
+#define STX_MEM(SIZE, DST, SRC, OFF) \
+  INSN(BPF_STX | (SIZE) | BPF_MEM, DST, SRC, OFF, 0)
+#define LD_ABS(SIZE, IMM) INSN(BPF_LD | (SIZE) | BPF_ABS, 0, 0, 0, IMM)
+#define LD_MAP_FD(DST, FD) \
+  INSN(BPF_LD | BPF_DW | BPF_IMM, DST, BPF_PSEUDO_MAP_FD, 0, FD), \
+  INSN(0, 0, 0, 0, 0)
+#define JMP_IMM(OP, DST, IMM, OFF) INSN(BPF_JMP | (OP) | BPF_K, DST, 0, OFF, IMM)
+#define JMP_REG(OP, DST, SRC, OFF) INSN(BPF_JMP | (OP) | BPF_X, DST, SRC, OFF, 0)
+#define CALL(FUNC) INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FUNC)
+#define EXIT() INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+#define SKB_OFF(FIELD) ((short) offsetof(struct __sk_buff, FIELD))
+#define DEST_OFF(FIELD) ((short) offsetof(struct edt_dest, FIELD))
+
+/* Offset of the destination address in an IPv4 packet on Ethernet (cls_bpf
+ * pushes the MAC header back on ingress) */
+#define DADDR_OFF (ETH_HLEN + 16)
+/* BPF_SKB_TSTAMP_DELIVERY_MONO, renamed BPF_SKB_CLOCK_MONOTONIC in recent
+ * headers */
+#define TSTAMP_MONO 1
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+  int ret = syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+
+  return (ret < 0 ? -errno : ret);
+}
+
+int edt_map_create(unsigned int max_entries)
+{
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_HASH;
+  attr.key_size = sizeof(__u32);
+  attr.value_size = sizeof(struct edt_dest);
+  attr.max_entries = max_entries;
+  strncpy(attr.map_name, "distem_edt", sizeof(attr.map_name) - 1);
+
+  return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+/* Load the program that redirects the known destinations to ifindex (not
+ * redirected if ifindex is 0). The messages of the verifier are written in log
+ * if it rejects the program */
+int edt_prog_load(int map_fd, int ifindex, char *log, size_t loglen)
+{
+  struct bpf_insn prog[] = {
+    MOV64_REG(BPF_REG_6, BPF_REG_1),
+    /* 1: IPv4 only */
+    LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_6, SKB_OFF(protocol)),
+    JMP_IMM(BPF_JNE, BPF_REG_0, htons(ETH_P_IP), 32),  /* goto out */
+    /* 3: dest = map[daddr] */
+    LD_ABS(BPF_W, DADDR_OFF),
+    STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, -4),
+    MOV64_REG(BPF_REG_2, BPF_REG_10),
+    ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+    LD_MAP_FD(BPF_REG_1, map_fd),
+    CALL(BPF_FUNC_map_lookup_elem),
+    JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 24),                 /* goto out */
+    MOV64_REG(BPF_REG_7, BPF_REG_0),
+    /* 12: t = now */
+    CALL(BPF_FUNC_ktime_get_ns),
+    MOV64_REG(BPF_REG_8, BPF_REG_0),
+    /* 14: if rate, t = max(t, next) and next = t + len / rate */
+    LDX_MEM(BPF_DW, BPF_REG_9, BPF_REG_7, DEST_OFF(rate)),
+    JMP_IMM(BPF_JEQ, BPF_REG_9, 0, 8),                  /* goto delay */
+    LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_7, DEST_OFF(next)),
+    JMP_REG(BPF_JGE, BPF_REG_8, BPF_REG_1, 1),
+    MOV64_REG(BPF_REG_8, BPF_REG_1),
+    LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, SKB_OFF(len)),
+    ALU64_IMM(BPF_MUL, BPF_REG_2, 1000000000),
+    ALU64_REG(BPF_DIV, BPF_REG_2, BPF_REG_9),
+    ALU64_REG(BPF_ADD, BPF_REG_2, BPF_REG_8),
+    STX_MEM(BPF_DW, BPF_REG_7, BPF_REG_2, DEST_OFF(next)),
+    /* 24: delay: tstamp = t + delay */
+    LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_7, DEST_OFF(delay)),
+    ALU64_REG(BPF_ADD, BPF_REG_8, BPF_REG_1),
+    MOV64_REG(BPF_REG_1, BPF_REG_6),
+    MOV64_REG(BPF_REG_2, BPF_REG_8),
+    MOV64_IMM(BPF_REG_3, TSTAMP_MONO),
+    CALL(BPF_FUNC_skb_set_tstamp),
+    /* 30: if ifindex, return redirect(ifindex) */
+    MOV64_IMM(BPF_REG_1, ifindex),
+    JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 3),                  /* goto out */
+    MOV64_IMM(BPF_REG_2, 0),
+    CALL(BPF_FUNC_redirect),
+    EXIT(),
+    /* 35: out: return TC_ACT_OK */
+    MOV64_IMM(BPF_REG_0, TC_ACT_OK),
+    EXIT(),
+  };
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_SCHED_CLS;
+  attr.insns = (__u64) (unsigned long) prog;
+  attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+  attr.license = (__u64) (unsigned long) "GPL";
+  strncpy(attr.prog_name, "distem_edt", sizeof(attr.prog_name) - 1);
+  if (log && loglen)
+  {
+    log[0] = '\0';
+    attr.log_buf = (__u64) (unsigned long) log;
+    attr.log_size = loglen;
+    attr.log_level = 1;
+  }
+
+  return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+int edt_pin(int fd, const char *path)
+{
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.pathname = (__u64) (unsigned long) path;
+  attr.bpf_fd = fd;
+
+  return sys_bpf(BPF_OBJ_PIN, &attr);
+}
+
+static int map_elem(int cmd, int map_fd, const void *key, void *value,
+  __u64 flags)
+{
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = map_fd;
+  attr.key = (__u64) (unsigned long) key;
+  attr.value = (__u64) (unsigned long) value;
+  attr.flags = flags;
+
+  return sys_bpf(cmd, &attr);
+}
+
+int edt_update(int map_fd, __u32 addr, const struct edt_dest *dest)
+{
+  return map_elem(BPF_MAP_UPDATE_ELEM, map_fd, &addr, (void *) dest, BPF_ANY);
+}
+
+int edt_delete(int map_fd, __u32 addr)
+{
+  return map_elem(BPF_MAP_DELETE_ELEM, map_fd, &addr, NULL, 0);
+}
+
+int edt_lookup(int map_fd, __u32 addr, struct edt_dest *dest)
+{
+  return map_elem(BPF_MAP_LOOKUP_ELEM, map_fd, &addr, dest, 0);
+}
+
+/* The first key if addr is NULL, -ENOENT after the last one */
+int edt_next_key(int map_fd, const __u32 *addr, __u32 *next)
+{
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = map_fd;
+  attr.key = (__u64) (unsigned long) addr;
+  attr.next_key = (__u64) (unsigned long) next;
+
+  return sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr);
+}
@@ -0,0 +1,39 @@
+#ifndef _EDT_H
+#define _EDT_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+/*
+ * Per destination classifier of the ebpf network algorithm. A sched_cls
+ * program, attached on the clsact ingress hook of a virtual interface, looks
+ * up the destination of the IPv4 packets in a BPF hash map. The packets of the
+ * known destinations get an Earliest Departure Time (delay, and pacing at the
+ * rate of the destination) and are redirected to the egress of an ifb device,
+ * where a fq qdisc holds them until then. Without ifb device, the program is
+ * attached on the clsact egress hook of the interface of the vnode (in its
+ * network namespace) and the packets are held by the fq qdisc of this
+ * interface. The other packets are not touched.
+ * Changing a destination is a single update of the map.
+ */
+
+#define EDT_MAX_ENTRIES 65536
+#define EDT_LOGSIZE 65536
+
+/* Value of the map, the key is the IPv4 address in host byte order */
+struct edt_dest {
+  __u64 delay;  /* ns */
+  __u64 rate;   /* bytes/s, 0 if unlimited */
+  __u64 next;   /* departure time of the next packet at rate (set by the program) */
+};
+
+int edt_map_create(unsigned int max_entries);
+int edt_prog_load(int map_fd, int ifindex, char *log, size_t loglen);
+int edt_pin(int fd, const char *path);
+
+int edt_update(int map_fd, __u32 addr, const struct edt_dest *dest);
+int edt_delete(int map_fd, __u32 addr);
+int edt_lookup(int map_fd, __u32 addr, struct edt_dest *dest);
+int edt_next_key(int map_fd, const __u32 *addr, __u32 *next);
+
+#endif
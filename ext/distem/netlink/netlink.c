@@ -0,0 +1,752 @@
+#include <ruby.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/if_addr.h>
+#include <linux/pkt_sched.h>
+#include "rtnl.h"
+#include "edt.h"
+
+/*
+ * Ruby interface of the rtnetlink client, used by Distem::Lib::NetTools to
+ * set up the interfaces of the physical node without running ip/brctl/tc and
+ * the neighbor tables of the vnodes without running arp in them, and of the
+ * eBPF classifier of Distem::Algorithm::Network::EBPF.
+ */
+
+static VALUE m_net;
+static VALUE c_rtnl;
+static VALUE c_edt;
+
+static void rtnl_free(void *ptr)
+{
+  rtnl_handle *h = (rtnl_handle *) ptr;
+
+  rtnl_close(h);
+  xfree(h);
+}
+
+static const rb_data_type_t rtnl_type = {
+  "NetworkExtension::RTNetlink",
+  { 0, rtnl_free, 0, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE rtnl_alloc(VALUE klass)
+{
+  rtnl_handle *h;
+  VALUE obj = TypedData_Make_Struct(klass, rtnl_handle, &rtnl_type, h);
+
+  h->fd = -1;
+  return obj;
+}
+
+static rtnl_handle *get_handle(VALUE self)
+{
+  rtnl_handle *h;
+
+  TypedData_Get_Struct(self, rtnl_handle, &rtnl_type, h);
+  if (h->fd < 0)
+    rb_raise(rb_eIOError, "closed rtnetlink socket");
+  return h;
+}
+
+/* Raise a SystemCallError describing the request(s) that failed */
+static void check(rtnl_handle *h, int ret, const char *what)
+{
+  char msg[RTNL_ERRSIZE];
+
+  if (ret >= 0)
+    return;
+
+  snprintf(msg, sizeof(msg), "%s", (h->error[0] ? h->error : what));
+  h->error[0] = '\0';
+  rb_syserr_fail(-ret, msg);
+}
+
+static VALUE opt(VALUE opts, const char *key)
+{
+  if (NIL_P(opts))
+    return Qnil;
+  Check_Type(opts, T_HASH);
+  return rb_hash_lookup(opts, rb_str_new2(key));
+}
+
+static int has_opt(VALUE opts, const char *key)
+{
+  return (!NIL_P(opts) && RTEST(rb_funcall(opts, rb_intern("has_key?"), 1,
+    rb_str_new2(key))));
+}
+
+static struct in_addr parse_addr(VALUE str)
+{
+  struct in_addr addr;
+
+  if (inet_pton(AF_INET, StringValueCStr(str), &addr) != 1)
+    rb_raise(rb_eArgError, "invalid IPv4 address '%s'", StringValueCStr(str));
+  return addr;
+}
+
+/* "10.0.0.1/24" or "10.0.0.1/255.255.255.0" */
+static struct in_addr parse_cidr(VALUE cidr, unsigned char *prefixlen)
+{
+  char buf[2 * INET_ADDRSTRLEN], *slash, *end;
+  struct in_addr addr, mask;
+  unsigned int bits;
+  long len = 32;
+
+  snprintf(buf, sizeof(buf), "%s", StringValueCStr(cidr));
+  if ((slash = strchr(buf, '/')))
+  {
+    *slash++ = '\0';
+    if (strchr(slash, '.'))
+    {
+      if (inet_pton(AF_INET, slash, &mask) != 1)
+        len = -1;
+      else
+      {
+        bits = ntohl(mask.s_addr);
+        for (len = 0; bits & 0x80000000U; bits <<= 1)
+          len++;
+        if (bits)
+          len = -1;
+      }
+    }
+    else
+    {
+      len = strtol(slash, &end, 10);
+      if (end == slash || *end)
+        len = -1;
+    }
+  }
+  if (len < 0 || len > 32 || inet_pton(AF_INET, buf, &addr) != 1)
+    rb_raise(rb_eArgError, "invalid IPv4 address '%s'", StringValueCStr(cidr));
+  *prefixlen = (unsigned char) len;
+
+  return addr;
+}
+
+/* "02:00:0a:00:00:01" */
+static void parse_mac(VALUE str, unsigned char mac[6])
+{
+  unsigned int b[6];
+  char end;
+  int i;
+
+  if (sscanf(StringValueCStr(str), "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2],
+    &b[3], &b[4], &b[5], &end) != 6)
+    rb_raise(rb_eArgError, "invalid MAC address '%s'", StringValueCStr(str));
+  for (i = 0; i < 6; i++)
+  {
+    if (b[i] > 0xff)
+      rb_raise(rb_eArgError, "invalid MAC address '%s'", StringValueCStr(str));
+    mac[i] = (unsigned char) b[i];
+  }
+}
+
+static VALUE addr_str(const void *addr)
+{
+  char buf[INET_ADDRSTRLEN];
+
+  inet_ntop(AF_INET, addr, buf, sizeof(buf));
+  return rb_str_new2(buf);
+}
+
+static VALUE ifname(int ifindex)
+{
+  char buf[IF_NAMESIZE];
+
+  return (if_indextoname(ifindex, buf) ? rb_str_new2(buf) : Qnil);
+}
+
+/* The socket is opened in the network namespace netns if given (i.e.
+ * "/proc/<pid>/ns/net" for the one of a container) */
+static VALUE rtnl_initialize(int argc, VALUE *argv, VALUE self)
+{
+  rtnl_handle *h;
+  int ret;
+  VALUE netns;
+
+  rb_scan_args(argc, argv, "01", &netns);
+  TypedData_Get_Struct(self, rtnl_handle, &rtnl_type, h);
+  if (NIL_P(netns))
+    ret = rtnl_open(h);
+  else
+    ret = rtnl_open_netns(h, StringValueCStr(netns));
+  if (ret < 0)
+    rb_syserr_fail_str(-ret, NIL_P(netns) ? rb_str_new2("rtnetlink socket")
+      : rb_sprintf("rtnetlink socket in %" PRIsVALUE, netns));
+
+  return self;
+}
+
+static VALUE rtnl_m_close(VALUE self)
+{
+  rtnl_handle *h;
+
+  TypedData_Get_Struct(self, rtnl_handle, &rtnl_type, h);
+  rtnl_close(h);
+
+  return Qnil;
+}
+
+static VALUE rtnl_m_commit(VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+
+  check(h, rtnl_commit(h), "commit");
+  return Qnil;
+}
+
+static VALUE batch_yield(VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+  VALUE ret;
+
+  h->batch++;
+  ret = rb_yield(self);
+  if (h->batch == 1)
+    check(h, rtnl_commit(h), "commit");
+
+  return ret;
+}
+
+static VALUE batch_ensure(VALUE self)
+{
+  rtnl_handle *h;
+
+  TypedData_Get_Struct(self, rtnl_handle, &rtnl_type, h);
+  /* the requests of a block that raised are dropped */
+  if (h->batch && !--h->batch)
+    rtnl_discard(h);
+
+  return Qnil;
+}
+
+/* Queue the requests made in the block and send them in a single message at
+ * the end of the block */
+static VALUE rtnl_batch(VALUE self)
+{
+  rb_need_block();
+  return rb_ensure(batch_yield, self, batch_ensure, self);
+}
+
+/* Options: 'mtu', 'peer' (veth), 'id', 'group', 'ttl', 'dev', 'dstport'
+ * (vxlan), 'forward_delay' and 'ageing_time' in seconds (bridge) */
+static VALUE rtnl_link_add_m(int argc, VALUE *argv, VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+  rtnl_link_opts lo;
+  VALUE name, kind, opts, tmp;
+
+  rb_scan_args(argc, argv, "21", &name, &kind, &opts);
+  memset(&lo, 0, sizeof(lo));
+  lo.forward_delay = -1;
+  lo.ageing_time = -1;
+
+  if (!NIL_P(tmp = opt(opts, "mtu")))
+    lo.mtu = NUM2UINT(tmp);
+  if (!NIL_P(tmp = opt(opts, "peer")))
+    lo.peer = StringValueCStr(tmp);
+  if (!NIL_P(tmp = opt(opts, "id")))
+    lo.vxlan_id = NUM2UINT(tmp);
+  if (!NIL_P(tmp = opt(opts, "group")))
+    lo.group = parse_addr(tmp);
+  if (!NIL_P(tmp = opt(opts, "ttl")))
+    lo.ttl = NUM2UINT(tmp);
+  if (!NIL_P(tmp = opt(opts, "dev")))
+    lo.dev = StringValueCStr(tmp);
+  if (!NIL_P(tmp = opt(opts, "dstport")))
+    lo.port = (unsigned short) NUM2UINT(tmp);
+  if (!NIL_P(tmp = opt(opts, "forward_delay")))
+    lo.forward_delay = (int) (NUM2DBL(tmp) * 100);
+  if (!NIL_P(tmp = opt(opts, "ageing_time")))
+    lo.ageing_time = (long long) (NUM2DBL(tmp) * 100);
+
+  check(h, rtnl_link_add(h, StringValueCStr(name), StringValueCStr(kind), &lo),
+    "link add");
+  return Qnil;
+}
+
+static VALUE rtnl_link_del_m(VALUE self, VALUE name)
+{
+  rtnl_handle *h = get_handle(self);
+
+  check(h, rtnl_link_del(h, StringValueCStr(name)), "link del");
+  return Qnil;
+}
+
+static void set_flag(VALUE opts, const char *key, unsigned int flag,
+  unsigned int *change, unsigned int *flags)
+{
+  if (!has_opt(opts, key))
+    return;
+  *change |= flag;
+  if (RTEST(opt(opts, key)))
+    *flags |= flag;
+}
+
+/* Options: 'up', 'promisc' (true or false), 'master' (name of the bridge, nil
+ * to release the interface), 'mtu' */
+static VALUE rtnl_link_set_m(VALUE self, VALUE name, VALUE opts)
+{
+  rtnl_handle *h = get_handle(self);
+  unsigned int change = 0, flags = 0, mtu = 0;
+  const char *master = NULL;
+  VALUE tmp;
+
+  Check_Type(opts, T_HASH);
+  set_flag(opts, "up", IFF_UP, &change, &flags);
+  set_flag(opts, "promisc", IFF_PROMISC, &change, &flags);
+  if (has_opt(opts, "master"))
+    master = (NIL_P(tmp = opt(opts, "master")) ? "" : StringValueCStr(tmp));
+  if (!NIL_P(tmp = opt(opts, "mtu")))
+    mtu = NUM2UINT(tmp);
+
+  check(h, rtnl_link_set(h, StringValueCStr(name), change, flags, master, mtu),
+    "link set");
+  return Qnil;
+}
+
+/* Options: 'broadcast', 'label' */
+static VALUE rtnl_addr_add_m(int argc, VALUE *argv, VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+  struct in_addr addr, brd;
+  unsigned char prefixlen;
+  const char *label = NULL;
+  int has_brd = 0;
+  VALUE name, cidr, opts, tmp;
+
+  rb_scan_args(argc, argv, "21", &name, &cidr, &opts);
+  addr = parse_cidr(cidr, &prefixlen);
+  if (!NIL_P(tmp = opt(opts, "broadcast")))
+  {
+    brd = parse_addr(tmp);
+    has_brd = 1;
+  }
+  if (!NIL_P(tmp = opt(opts, "label")))
+    label = StringValueCStr(tmp);
+
+  check(h, rtnl_addr(h, RTM_NEWADDR, StringValueCStr(name), addr, prefixlen,
+    (has_brd ? &brd : NULL), label), "addr add");
+  return Qnil;
+}
+
+static VALUE rtnl_addr_del_m(VALUE self, VALUE name, VALUE cidr)
+{
+  rtnl_handle *h = get_handle(self);
+  struct in_addr addr;
+  unsigned char prefixlen;
+
+  addr = parse_cidr(cidr, &prefixlen);
+  check(h, rtnl_addr(h, RTM_DELADDR, StringValueCStr(name), addr, prefixlen,
+    NULL, NULL), "addr del");
+  return Qnil;
+}
+
+/* Add (or replace) the permanent entry of an address of the neighbor table */
+static VALUE rtnl_neigh_add_m(VALUE self, VALUE name, VALUE addr, VALUE mac)
+{
+  rtnl_handle *h = get_handle(self);
+  unsigned char lladdr[6];
+  struct in_addr dst = parse_addr(addr);
+
+  parse_mac(mac, lladdr);
+  check(h, rtnl_neigh(h, RTM_NEWNEIGH, StringValueCStr(name), dst, lladdr,
+    sizeof(lladdr)), "neigh add");
+  return Qnil;
+}
+
+static VALUE rtnl_neigh_del_m(VALUE self, VALUE name, VALUE addr)
+{
+  rtnl_handle *h = get_handle(self);
+
+  check(h, rtnl_neigh(h, RTM_DELNEIGH, StringValueCStr(name), parse_addr(addr),
+    NULL, 0), "neigh del");
+  return Qnil;
+}
+
+static int link_fn(struct nlmsghdr *n, void *arg)
+{
+  struct ifinfomsg *i = NLMSG_DATA(n);
+  struct rtattr *rta, *tb, *info;
+  int len = IFLA_PAYLOAD(n);
+  VALUE link = rb_hash_new();
+
+  tb = IFLA_RTA(i);
+  rb_hash_aset(link, rb_str_new2("index"), INT2NUM(i->ifi_index));
+  rb_hash_aset(link, rb_str_new2("up"), (i->ifi_flags & IFF_UP) ? Qtrue : Qfalse);
+  if ((rta = rtnl_attr(tb, len, IFLA_IFNAME)))
+    rb_hash_aset(link, rb_str_new2("name"), rb_str_new2(RTA_DATA(rta)));
+  if ((rta = rtnl_attr(tb, len, IFLA_MTU)))
+    rb_hash_aset(link, rb_str_new2("mtu"), UINT2NUM(*(unsigned int *) RTA_DATA(rta)));
+  if ((rta = rtnl_attr(tb, len, IFLA_MASTER)))
+    rb_hash_aset(link, rb_str_new2("master"), ifname(*(int *) RTA_DATA(rta)));
+  if ((info = rtnl_attr(tb, len, IFLA_LINKINFO))
+    && (rta = rtnl_attr(RTA_DATA(info), RTA_PAYLOAD(info), IFLA_INFO_KIND)))
+    rb_hash_aset(link, rb_str_new2("kind"),
+      rb_str_new(RTA_DATA(rta), strnlen(RTA_DATA(rta), RTA_PAYLOAD(rta))));
+  rb_ary_push((VALUE) arg, link);
+
+  return 0;
+}
+
+/* Every link of the node as Hashes ('name', 'index', 'kind', 'up', 'mtu',
+ * 'master') */
+static VALUE rtnl_links_m(VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+  VALUE links = rb_ary_new();
+
+  check(h, rtnl_link_dump(h, link_fn, (void *) links), "link dump");
+  return links;
+}
+
+static int addr_fn(struct nlmsghdr *n, void *arg)
+{
+  struct ifaddrmsg *a = NLMSG_DATA(n);
+  struct rtattr *rta, *tb;
+  int len = IFA_PAYLOAD(n);
+  VALUE addr = rb_hash_new();
+
+  tb = IFA_RTA(a);
+  rb_hash_aset(addr, rb_str_new2("dev"), ifname(a->ifa_index));
+  rb_hash_aset(addr, rb_str_new2("prefixlen"), INT2NUM(a->ifa_prefixlen));
+  if ((rta = rtnl_attr(tb, len, IFA_LOCAL))
+    || (rta = rtnl_attr(tb, len, IFA_ADDRESS)))
+    rb_hash_aset(addr, rb_str_new2("address"), addr_str(RTA_DATA(rta)));
+  if ((rta = rtnl_attr(tb, len, IFA_BROADCAST)))
+    rb_hash_aset(addr, rb_str_new2("broadcast"), addr_str(RTA_DATA(rta)));
+  if ((rta = rtnl_attr(tb, len, IFA_LABEL)))
+    rb_hash_aset(addr, rb_str_new2("label"), rb_str_new2(RTA_DATA(rta)));
+  rb_ary_push((VALUE) arg, addr);
+
+  return 0;
+}
+
+static int name_index(rtnl_handle *h, VALUE name)
+{
+  int idx;
+
+  if (NIL_P(name))
+    return 0;
+  idx = rtnl_ifindex(h, StringValueCStr(name));
+  if (idx < 0)
+    rb_syserr_fail(-idx, StringValueCStr(name));
+  return idx;
+}
+
+/* IPv4 addresses of an interface (of every interface if name is nil) as
+ * Hashes ('dev', 'address', 'prefixlen', 'broadcast', 'label') */
+static VALUE rtnl_addrs_m(int argc, VALUE *argv, VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+  VALUE name, addrs = rb_ary_new();
+
+  rb_scan_args(argc, argv, "01", &name);
+  check(h, rtnl_addr_dump(h, name_index(h, name), addr_fn, (void *) addrs),
+    "addr dump");
+  return addrs;
+}
+
+static int qdisc_fn(struct nlmsghdr *n, void *arg)
+{
+  struct tcmsg *t = NLMSG_DATA(n);
+  struct rtattr *rta;
+  int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*t));
+  VALUE qdisc = rb_hash_new();
+
+  rb_hash_aset(qdisc, rb_str_new2("dev"), ifname(t->tcm_ifindex));
+  rb_hash_aset(qdisc, rb_str_new2("handle"), UINT2NUM(t->tcm_handle));
+  rb_hash_aset(qdisc, rb_str_new2("parent"), UINT2NUM(t->tcm_parent));
+  if ((rta = rtnl_attr(TCA_RTA(t), len, TCA_KIND)))
+    rb_hash_aset(qdisc, rb_str_new2("kind"), rb_str_new2(RTA_DATA(rta)));
+  rb_ary_push((VALUE) arg, qdisc);
+
+  return 0;
+}
+
+/* Qdiscs of an interface (of every interface if name is nil) as Hashes
+ * ('dev', 'kind', 'handle', 'parent'), the parent of the root qdisc is
+ * RTNetlink::TC_H_ROOT */
+static VALUE rtnl_qdiscs_m(int argc, VALUE *argv, VALUE self)
+{
+  rtnl_handle *h = get_handle(self);
+  VALUE name, qdiscs = rb_ary_new();
+
+  rb_scan_args(argc, argv, "01", &name);
+  check(h, rtnl_qdisc_dump(h, name_index(h, name), qdisc_fn, (void *) qdiscs),
+    "qdisc dump");
+  return qdiscs;
+}
+
+typedef struct {
+  int map_fd;
+  int prog_fd;
+  char path[PATH_MAX];
+} edt_handle;
+
+static void edt_unpin(edt_handle *e)
+{
+  char buf[PATH_MAX + 8];
+
+  snprintf(buf, sizeof(buf), "%s/prog", e->path);
+  unlink(buf);
+  snprintf(buf, sizeof(buf), "%s/map", e->path);
+  unlink(buf);
+  rmdir(e->path);
+}
+
+static void edt_close(edt_handle *e)
+{
+  if (e->prog_fd >= 0)
+    close(e->prog_fd);
+  if (e->map_fd >= 0)
+  {
+    close(e->map_fd);
+    edt_unpin(e);
+  }
+  e->prog_fd = e->map_fd = -1;
+}
+
+static void edt_free(void *ptr)
+{
+  edt_close((edt_handle *) ptr);
+  xfree(ptr);
+}
+
+static const rb_data_type_t edt_type = {
+  "NetworkExtension::EDTClassifier",
+  { 0, edt_free, 0, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE edt_alloc(VALUE klass)
+{
+  edt_handle *e;
+  VALUE obj = TypedData_Make_Struct(klass, edt_handle, &edt_type, e);
+
+  e->map_fd = e->prog_fd = -1;
+  return obj;
+}
+
+static edt_handle *get_edt(VALUE self)
+{
+  edt_handle *e;
+
+  TypedData_Get_Struct(self, edt_handle, &edt_type, e);
+  if (e->map_fd < 0)
+    rb_raise(rb_eIOError, "closed classifier");
+  return e;
+}
+
+/* The key of a destination, a host address ("10.0.0.1" or "10.0.0.1/32") */
+static __u32 edt_key(VALUE addr)
+{
+  unsigned char prefixlen;
+  struct in_addr a = parse_cidr(addr, &prefixlen);
+
+  if (prefixlen != 32)
+    rb_raise(rb_eArgError, "'%s' is not a host address", StringValueCStr(addr));
+  return ntohl(a.s_addr);
+}
+
+static VALUE edt_addr(__u32 key)
+{
+  struct in_addr a = { htonl(key) };
+
+  return addr_str(&a);
+}
+
+static int edt_setup(edt_handle *e, unsigned int max, unsigned int ifindex,
+  char *log, const char **what)
+{
+  char buf[PATH_MAX + 8];
+  int ret;
+
+  *what = "bpf map";
+  if ((ret = edt_map_create(max)) < 0)
+    return ret;
+  e->map_fd = ret;
+  *what = "bpf program";
+  if ((ret = edt_prog_load(e->map_fd, ifindex, log, EDT_LOGSIZE)) < 0)
+    return ret;
+  e->prog_fd = ret;
+  *what = "bpf pin";
+  snprintf(buf, sizeof(buf), "%s/map", e->path);
+  if ((ret = edt_pin(e->map_fd, buf)) < 0)
+    return ret;
+  snprintf(buf, sizeof(buf), "%s/prog", e->path);
+  return edt_pin(e->prog_fd, buf);
+}
+
+/* Create the map and the program of the classifier, that redirects the known
+ * destinations to the ifb device (if ifb is nil, the packets are not
+ * redirected, the program is attached on the egress hook of the interface
+ * they are shaped on). Both are pinned in the directory path (on a bpf
+ * filesystem, its parent must exist) so that tc can attach the program */
+static VALUE edt_initialize(int argc, VALUE *argv, VALUE self)
+{
+  edt_handle *e;
+  const char *what;
+  char *log;
+  unsigned int ifindex;
+  int ret;
+  VALUE path, ifb, max, msg;
+
+  rb_scan_args(argc, argv, "21", &path, &ifb, &max);
+  TypedData_Get_Struct(self, edt_handle, &edt_type, e);
+  edt_close(e);
+  snprintf(e->path, sizeof(e->path), "%s", StringValueCStr(path));
+  if (NIL_P(ifb))
+    ifindex = 0;
+  else if (!(ifindex = if_nametoindex(StringValueCStr(ifb))))
+    rb_syserr_fail(errno, StringValueCStr(ifb));
+  /* pins left by a previous run */
+  edt_unpin(e);
+  if (mkdir(e->path, 0700) && errno != EEXIST)
+    rb_syserr_fail(errno, e->path);
+
+  log = ALLOC_N(char, EDT_LOGSIZE);
+  log[0] = '\0';
+  ret = edt_setup(e, (NIL_P(max) ? EDT_MAX_ENTRIES : NUM2UINT(max)), ifindex,
+    log, &what);
+  if (ret < 0)
+  {
+    edt_close(e);
+    msg = rb_sprintf("%s%s%s", what, (log[0] ? ": " : ""), log);
+    xfree(log);
+    rb_syserr_fail_str(-ret, msg);
+  }
+  xfree(log);
+
+  return self;
+}
+
+static VALUE edt_m_close(VALUE self)
+{
+  edt_handle *e;
+
+  TypedData_Get_Struct(self, edt_handle, &edt_type, e);
+  edt_close(e);
+
+  return Qnil;
+}
+
+/* The pinned program, to attach with "tc filter ... bpf object-pinned" */
+static VALUE edt_prog_path(VALUE self)
+{
+  return rb_sprintf("%s/prog", get_edt(self)->path);
+}
+
+/* Set the delay (ns) and the rate (bytes/s, 0 if unlimited) of a destination */
+static VALUE edt_update_m(int argc, VALUE *argv, VALUE self)
+{
+  edt_handle *e = get_edt(self);
+  struct edt_dest dest;
+  int ret;
+  VALUE addr, delay, rate;
+
+  rb_scan_args(argc, argv, "21", &addr, &delay, &rate);
+  memset(&dest, 0, sizeof(dest));
+  dest.delay = NUM2ULL(delay);
+  dest.rate = (NIL_P(rate) ? 0 : NUM2ULL(rate));
+  if ((ret = edt_update(e->map_fd, edt_key(addr), &dest)) < 0)
+    rb_syserr_fail(-ret, StringValueCStr(addr));
+
+  return Qnil;
+}
+
+/* Remove a destination, returns false if it was unknown */
+static VALUE edt_delete_m(VALUE self, VALUE addr)
+{
+  edt_handle *e = get_edt(self);
+  int ret = edt_delete(e->map_fd, edt_key(addr));
+
+  if (ret == -ENOENT)
+    return Qfalse;
+  if (ret < 0)
+    rb_syserr_fail(-ret, StringValueCStr(addr));
+
+  return Qtrue;
+}
+
+/* [delay, rate] of a destination, nil if it is unknown */
+static VALUE edt_get_m(VALUE self, VALUE addr)
+{
+  edt_handle *e = get_edt(self);
+  struct edt_dest dest;
+  int ret = edt_lookup(e->map_fd, edt_key(addr), &dest);
+
+  if (ret == -ENOENT)
+    return Qnil;
+  if (ret < 0)
+    rb_syserr_fail(-ret, StringValueCStr(addr));
+
+  return rb_assoc_new(ULL2NUM(dest.delay), ULL2NUM(dest.rate));
+}
+
+/* Every destination, as { address => [delay, rate] } */
+static VALUE edt_entries_m(VALUE self)
+{
+  edt_handle *e = get_edt(self);
+  struct edt_dest dest;
+  __u32 key, next;
+  int ret;
+  VALUE entries = rb_hash_new();
+
+  for (ret = edt_next_key(e->map_fd, NULL, &next); ret == 0;
+    ret = edt_next_key(e->map_fd, &key, &next))
+  {
+    key = next;
+    if (edt_lookup(e->map_fd, key, &dest) == 0)
+      rb_hash_aset(entries, edt_addr(key),
+        rb_assoc_new(ULL2NUM(dest.delay), ULL2NUM(dest.rate)));
+  }
+  if (ret != -ENOENT)
+    rb_syserr_fail(-ret, "bpf map");
+
+  return entries;
+}
+
+void Init_netlink()
+{
+  m_net = rb_define_module("NetworkExtension");
+  c_rtnl = rb_define_class_under(m_net, "RTNetlink", rb_cObject);
+  rb_define_const(c_rtnl, "TC_H_ROOT", UINT2NUM(TC_H_ROOT));
+  rb_define_const(c_rtnl, "TC_H_INGRESS", UINT2NUM(TC_H_INGRESS));
+  rb_define_alloc_func(c_rtnl, rtnl_alloc);
+  rb_define_method(c_rtnl, "initialize", rtnl_initialize, -1);
+  rb_define_method(c_rtnl, "close", rtnl_m_close, 0);
+  rb_define_method(c_rtnl, "batch", rtnl_batch, 0);
+  rb_define_method(c_rtnl, "commit", rtnl_m_commit, 0);
+  rb_define_method(c_rtnl, "link_add", rtnl_link_add_m, -1);
+  rb_define_method(c_rtnl, "link_del", rtnl_link_del_m, 1);
+  rb_define_method(c_rtnl, "link_set", rtnl_link_set_m, 2);
+  rb_define_method(c_rtnl, "addr_add", rtnl_addr_add_m, -1);
+  rb_define_method(c_rtnl, "addr_del", rtnl_addr_del_m, 2);
+  rb_define_method(c_rtnl, "neigh_add", rtnl_neigh_add_m, 3);
+  rb_define_method(c_rtnl, "neigh_del", rtnl_neigh_del_m, 2);
+  rb_define_method(c_rtnl, "links", rtnl_links_m, 0);
+  rb_define_method(c_rtnl, "addrs", rtnl_addrs_m, -1);
+  rb_define_method(c_rtnl, "qdiscs", rtnl_qdiscs_m, -1);
+
+  c_edt = rb_define_class_under(m_net, "EDTClassifier", rb_cObject);
+  rb_define_const(c_edt, "MAX_ENTRIES", UINT2NUM(EDT_MAX_ENTRIES));
+  rb_define_alloc_func(c_edt, edt_alloc);
+  rb_define_method(c_edt, "initialize", edt_initialize, -1);
+  rb_define_method(c_edt, "close", edt_m_close, 0);
+  rb_define_method(c_edt, "prog_path", edt_prog_path, 0);
+  rb_define_method(c_edt, "update", edt_update_m, -1);
+  rb_define_method(c_edt, "delete", edt_delete_m, 1);
+  rb_define_method(c_edt, "[]", edt_get_m, 1);
+  rb_define_method(c_edt, "entries", edt_entries_m, 0);
+}
@@ -0,0 +1,680 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/if_addr.h>
+#include <linux/veth.h>
+#include <linux/neighbour.h>
+#include "rtnl.h"
+
+#ifndef NETLINK_CAP_ACK
+#define NETLINK_CAP_ACK 10
+#endif
+
+/* The attributes are written after the header, in the whole request */
+#define REQ_MSG(req) ((struct nlmsghdr *) &(req))
+
+#define NLMSG_TAIL(n) \
+  ((struct rtattr *) (((char *) (n)) + NLMSG_ALIGN((n)->nlmsg_len)))
+
+typedef struct {
+  struct nlmsghdr n;
+  struct ifinfomsg i;
+  char buf[RTNL_REQSIZE];
+} link_req;
+
+typedef struct {
+  struct nlmsghdr n;
+  struct ifaddrmsg a;
+  char buf[RTNL_REQSIZE];
+} addr_req;
+
+typedef struct {
+  struct nlmsghdr n;
+  struct ndmsg nd;
+  char buf[RTNL_REQSIZE];
+} neigh_req;
+
+typedef struct {
+  struct nlmsghdr n;
+  struct tcmsg t;
+} qdisc_req;
+
+/* Every request with attributes is built in a link_req, an addr_req or a
+ * neigh_req, that all have RTNL_REQSIZE bytes after their header */
+static int addattr_l(struct nlmsghdr *n, int type, const void *data, size_t alen)
+{
+  size_t len = RTA_LENGTH(alen);
+  struct rtattr *rta;
+
+  if (NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len) > NLMSG_HDRLEN + RTNL_REQSIZE)
+    return -1;
+
+  rta = NLMSG_TAIL(n);
+  rta->rta_type = type;
+  rta->rta_len = len;
+  if (alen)
+    memcpy(RTA_DATA(rta),data,alen);
+  n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len);
+
+  return 0;
+}
+
+static int addattr8(struct nlmsghdr *n, int type, unsigned char val)
+{
+  return addattr_l(n,type,&val,sizeof(val));
+}
+
+static int addattr16(struct nlmsghdr *n, int type, unsigned short val)
+{
+  return addattr_l(n,type,&val,sizeof(val));
+}
+
+static int addattr32(struct nlmsghdr *n, int type, unsigned int val)
+{
+  return addattr_l(n,type,&val,sizeof(val));
+}
+
+static int addattr_str(struct nlmsghdr *n, int type, const char *str)
+{
+  return addattr_l(n,type,str,strlen(str) + 1);
+}
+
+static struct rtattr *nest_start(struct nlmsghdr *n, int type)
+{
+  struct rtattr *nest = NLMSG_TAIL(n);
+
+  return (addattr_l(n,type,NULL,0) ? NULL : nest);
+}
+
+static void nest_end(struct nlmsghdr *n, struct rtattr *nest)
+{
+  nest->rta_len = (char *) NLMSG_TAIL(n) - (char *) nest;
+}
+
+struct rtattr *rtnl_attr(struct rtattr *rta, int len, int type)
+{
+  for (; RTA_OK(rta,len); rta = RTA_NEXT(rta,len))
+    if (rta->rta_type == type)
+      return rta;
+
+  return NULL;
+}
+
+int rtnl_open(rtnl_handle *h)
+{
+  struct sockaddr_nl local;
+  int one = 1, bufsize = 4 * RTNL_BUFSIZE, rcvbuf = RTNL_MAX_PENDING * 2048;
+
+  memset(h,0,sizeof(*h));
+  h->fd = socket(AF_NETLINK,SOCK_RAW | SOCK_CLOEXEC,NETLINK_ROUTE);
+  if (h->fd < 0)
+    return -errno;
+
+  /* acknowledgements do not need a copy of the request */
+  setsockopt(h->fd,SOL_NETLINK,NETLINK_CAP_ACK,&one,sizeof(one));
+  setsockopt(h->fd,SOL_SOCKET,SO_SNDBUF,&bufsize,sizeof(bufsize));
+  /* every acknowledgement of a batch is accounted with the size of its skb
+   * (about 1KB), beyond rmem_max if allowed */
+  if (setsockopt(h->fd,SOL_SOCKET,SO_RCVBUFFORCE,&rcvbuf,sizeof(rcvbuf)) < 0)
+    setsockopt(h->fd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,sizeof(rcvbuf));
+
+  memset(&local,0,sizeof(local));
+  local.nl_family = AF_NETLINK;
+  if (bind(h->fd,(struct sockaddr *) &local,sizeof(local)) < 0)
+    goto err;
+
+  h->buf = malloc(RTNL_BUFSIZE);
+  h->rbuf = malloc(RTNL_BUFSIZE);
+  if (!h->buf || !h->rbuf)
+  {
+    errno = ENOMEM;
+    goto err;
+  }
+
+  return 0;
+
+err:
+  one = errno;
+  rtnl_close(h);
+  return -one;
+}
+
+/* Open the socket in the network namespace netns (i.e. /proc/<pid>/ns/net),
+ * the calling thread only enters it while the socket is created: the socket
+ * then stays bound to that namespace */
+int rtnl_open_netns(rtnl_handle *h, const char *netns)
+{
+  int fd, self, ret;
+
+  h->fd = -1;
+  if ((fd = open(netns,O_RDONLY | O_CLOEXEC)) < 0)
+    return -errno;
+  if ((self = open("/proc/thread-self/ns/net",O_RDONLY | O_CLOEXEC)) < 0)
+  {
+    ret = -errno;
+    close(fd);
+    return ret;
+  }
+
+  if (setns(fd,CLONE_NEWNET) < 0)
+    ret = -errno;
+  else
+  {
+    ret = rtnl_open(h);
+    if (setns(self,CLONE_NEWNET) < 0)
+    {
+      if (!ret)
+        ret = -errno;
+      rtnl_close(h);
+    }
+  }
+  close(fd);
+  close(self);
+
+  if (!ret)
+    h->netns = 1;
+  return ret;
+}
+
+void rtnl_close(rtnl_handle *h)
+{
+  if (h->fd >= 0)
+    close(h->fd);
+  h->fd = -1;
+  free(h->buf);
+  free(h->rbuf);
+  h->buf = NULL;
+  h->rbuf = NULL;
+  h->len = 0;
+  h->pending = 0;
+}
+
+static int rtnl_send(rtnl_handle *h, const void *buf, size_t len)
+{
+  struct sockaddr_nl nladdr;
+  struct iovec iov;
+  struct msghdr msg;
+  ssize_t ret;
+
+  memset(&nladdr,0,sizeof(nladdr));
+  nladdr.nl_family = AF_NETLINK;
+  iov.iov_base = (void *) buf;
+  iov.iov_len = len;
+  memset(&msg,0,sizeof(msg));
+  msg.msg_name = &nladdr;
+  msg.msg_namelen = sizeof(nladdr);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  do
+    ret = sendmsg(h->fd,&msg,0);
+  while (ret < 0 && errno == EINTR);
+
+  return (ret < 0 ? -errno : 0);
+}
+
+static ssize_t rtnl_recv(rtnl_handle *h)
+{
+  ssize_t ret;
+
+  do
+    ret = recv(h->fd,h->rbuf,RTNL_BUFSIZE,0);
+  while (ret < 0 && errno == EINTR);
+
+  if (ret == 0)
+    return -ECONNRESET;
+  return (ret < 0 ? -errno : ret);
+}
+
+static void rtnl_error(rtnl_handle *h, const char *desc, int err)
+{
+  size_t len = strlen(h->error);
+
+  snprintf(h->error + len,sizeof(h->error) - len,"%s%s (%s)",
+    (len ? "; " : ""),desc,strerror(-err));
+}
+
+/* Send the queued requests in a single message and wait for all the
+ * acknowledgements. Returns the first error, every failed request is
+ * described in h->error */
+int rtnl_commit(rtnl_handle *h)
+{
+  struct nlmsghdr *n;
+  struct nlmsgerr *e;
+  unsigned int acked, idx, pending;
+  ssize_t len;
+  int ret;
+
+  if (!h->pending)
+    return 0;
+
+  h->error[0] = '\0';
+  pending = h->pending;
+  ret = rtnl_send(h,h->buf,h->len);
+  h->len = 0;
+  h->pending = 0;
+  if (ret < 0)
+  {
+    rtnl_error(h,h->descs[0],ret);
+    return ret;
+  }
+
+  acked = 0;
+  while (acked < pending)
+  {
+    len = rtnl_recv(h);
+    if (len < 0)
+      return len;
+
+    for (n = (struct nlmsghdr *) h->rbuf; NLMSG_OK(n,len);
+      n = NLMSG_NEXT(n,len))
+    {
+      idx = n->nlmsg_seq - h->first_seq;
+      if (n->nlmsg_type != NLMSG_ERROR || idx >= pending)
+        continue;
+      acked++;
+      e = (struct nlmsgerr *) NLMSG_DATA(n);
+      if (e->error < 0)
+      {
+        rtnl_error(h,h->descs[idx],e->error);
+        if (!ret)
+          ret = e->error;
+      }
+    }
+  }
+
+  return ret;
+}
+
+void rtnl_discard(rtnl_handle *h)
+{
+  h->len = 0;
+  h->pending = 0;
+}
+
+/* Queue a request (and send it at once if not in batch mode) */
+static int rtnl_request(rtnl_handle *h, struct nlmsghdr *n, const char *desc)
+{
+  int ret;
+
+  if (h->pending == RTNL_MAX_PENDING
+    || h->len + NLMSG_ALIGN(n->nlmsg_len) > RTNL_BUFSIZE)
+  {
+    ret = rtnl_commit(h);
+    if (ret < 0)
+      return ret;
+  }
+
+  n->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+  n->nlmsg_seq = ++h->seq;
+  if (!h->pending)
+    h->first_seq = n->nlmsg_seq;
+  memcpy(h->buf + h->len,n,n->nlmsg_len);
+  h->len += NLMSG_ALIGN(n->nlmsg_len);
+  snprintf(h->descs[h->pending++],RTNL_DESCSIZE,"%s",desc);
+
+  return (h->batch ? 0 : rtnl_commit(h));
+}
+
+typedef struct {
+  const char *name;
+  int idx;
+} ifindex_arg;
+
+static int ifindex_fn(struct nlmsghdr *n, void *arg)
+{
+  ifindex_arg *a = (ifindex_arg *) arg;
+  struct ifinfomsg *i = NLMSG_DATA(n);
+  struct rtattr *rta = rtnl_attr(IFLA_RTA(i),IFLA_PAYLOAD(n),IFLA_IFNAME);
+
+  if (rta && !strcmp(RTA_DATA(rta),a->name))
+    a->idx = i->ifi_index;
+  return 0;
+}
+
+/* The interface can be created by a request that is still queued, the queue
+ * is then sent before looking for it again. if_nametoindex() looks in the
+ * namespace of the thread, the links of the namespace of the socket are
+ * dumped instead (the last interface found is kept) */
+int rtnl_ifindex(rtnl_handle *h, const char *name)
+{
+  ifindex_arg a = { name, 0 };
+  unsigned int idx;
+  int ret;
+
+  if (h->netns)
+  {
+    if (h->last_index && !strcmp(h->last_name,name))
+      return h->last_index;
+    if ((ret = rtnl_link_dump(h,ifindex_fn,&a)) < 0)
+      return ret;
+    if (!a.idx)
+      return -ENODEV;
+    snprintf(h->last_name,sizeof(h->last_name),"%s",name);
+    h->last_index = a.idx;
+    return a.idx;
+  }
+
+  idx = if_nametoindex(name);
+  if (!idx && h->pending)
+  {
+    ret = rtnl_commit(h);
+    if (ret < 0)
+      return ret;
+    idx = if_nametoindex(name);
+  }
+
+  return (idx ? (int) idx : -ENODEV);
+}
+
+int rtnl_link_add(rtnl_handle *h, const char *name, const char *kind,
+  const rtnl_link_opts *opts)
+{
+  link_req req;
+  struct rtattr *linkinfo, *data, *peer;
+  char desc[RTNL_DESCSIZE];
+  int err = 0, idx;
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.n.nlmsg_type = RTM_NEWLINK;
+  req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+  req.i.ifi_family = AF_UNSPEC;
+
+  err |= addattr_str(REQ_MSG(req),IFLA_IFNAME,name);
+  if (opts->mtu)
+    err |= addattr32(REQ_MSG(req),IFLA_MTU,opts->mtu);
+
+  if (!(linkinfo = nest_start(REQ_MSG(req),IFLA_LINKINFO)))
+    return -EMSGSIZE;
+  err |= addattr_l(REQ_MSG(req),IFLA_INFO_KIND,kind,strlen(kind));
+
+  if (!strcmp(kind,"veth") && opts->peer)
+  {
+    if (!(data = nest_start(REQ_MSG(req),IFLA_INFO_DATA))
+      || !(peer = nest_start(REQ_MSG(req),VETH_INFO_PEER)))
+      return -EMSGSIZE;
+    /* the peer is described by its own (empty) ifinfomsg */
+    if (NLMSG_ALIGN(req.n.nlmsg_len) + sizeof(struct ifinfomsg) > sizeof(req))
+      return -EMSGSIZE;
+    req.n.nlmsg_len = NLMSG_ALIGN(req.n.nlmsg_len) + sizeof(struct ifinfomsg);
+    err |= addattr_str(REQ_MSG(req),IFLA_IFNAME,opts->peer);
+    nest_end(REQ_MSG(req),peer);
+    nest_end(REQ_MSG(req),data);
+  }
+  else if (!strcmp(kind,"vxlan"))
+  {
+    if (!(data = nest_start(REQ_MSG(req),IFLA_INFO_DATA)))
+      return -EMSGSIZE;
+    err |= addattr32(REQ_MSG(req),IFLA_VXLAN_ID,opts->vxlan_id);
+    if (opts->group.s_addr)
+      err |= addattr_l(REQ_MSG(req),IFLA_VXLAN_GROUP,&opts->group,
+        sizeof(opts->group));
+    if (opts->dev)
+    {
+      if ((idx = rtnl_ifindex(h,opts->dev)) < 0)
+        return idx;
+      err |= addattr32(REQ_MSG(req),IFLA_VXLAN_LINK,idx);
+    }
+    if (opts->ttl)
+      err |= addattr8(REQ_MSG(req),IFLA_VXLAN_TTL,opts->ttl);
+    if (opts->port)
+      err |= addattr16(REQ_MSG(req),IFLA_VXLAN_PORT,htons(opts->port));
+    nest_end(REQ_MSG(req),data);
+  }
+  else if (!strcmp(kind,"bridge")
+    && (opts->forward_delay >= 0 || opts->ageing_time >= 0))
+  {
+    if (!(data = nest_start(REQ_MSG(req),IFLA_INFO_DATA)))
+      return -EMSGSIZE;
+    if (opts->forward_delay >= 0)
+      err |= addattr32(REQ_MSG(req),IFLA_BR_FORWARD_DELAY,opts->forward_delay);
+    if (opts->ageing_time >= 0)
+      err |= addattr32(REQ_MSG(req),IFLA_BR_AGEING_TIME,opts->ageing_time);
+    nest_end(REQ_MSG(req),data);
+  }
+  nest_end(REQ_MSG(req),linkinfo);
+
+  if (err)
+    return -EMSGSIZE;
+
+  snprintf(desc,sizeof(desc),"link add %s type %s",name,kind);
+  return rtnl_request(h,REQ_MSG(req),desc);
+}
+
+int rtnl_link_del(rtnl_handle *h, const char *name)
+{
+  link_req req;
+  char desc[RTNL_DESCSIZE];
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.n.nlmsg_type = RTM_DELLINK;
+  req.i.ifi_family = AF_UNSPEC;
+  if (addattr_str(REQ_MSG(req),IFLA_IFNAME,name))
+    return -EMSGSIZE;
+
+  snprintf(desc,sizeof(desc),"link del %s",name);
+  return rtnl_request(h,REQ_MSG(req),desc);
+}
+
+/* Change the flags in change to their value in flags, master is the name of
+ * the new master ("" to release the interface, NULL to leave it), mtu is left
+ * unchanged if 0 */
+int rtnl_link_set(rtnl_handle *h, const char *name, unsigned int change,
+  unsigned int flags, const char *master, unsigned int mtu)
+{
+  link_req req;
+  char desc[RTNL_DESCSIZE];
+  int err = 0, idx;
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.n.nlmsg_type = RTM_NEWLINK;
+  req.i.ifi_family = AF_UNSPEC;
+  req.i.ifi_change = change;
+  req.i.ifi_flags = flags;
+
+  err |= addattr_str(REQ_MSG(req),IFLA_IFNAME,name);
+  if (master)
+  {
+    idx = 0;
+    if (*master && (idx = rtnl_ifindex(h,master)) < 0)
+      return idx;
+    err |= addattr32(REQ_MSG(req),IFLA_MASTER,idx);
+  }
+  if (mtu)
+    err |= addattr32(REQ_MSG(req),IFLA_MTU,mtu);
+
+  if (err)
+    return -EMSGSIZE;
+
+  snprintf(desc,sizeof(desc),"link set %s",name);
+  return rtnl_request(h,REQ_MSG(req),desc);
+}
+
+int rtnl_addr(rtnl_handle *h, int cmd, const char *name, struct in_addr addr,
+  unsigned char prefixlen, const struct in_addr *brd, const char *label)
+{
+  addr_req req;
+  char desc[RTNL_DESCSIZE], str[INET_ADDRSTRLEN];
+  int err = 0, idx;
+
+  if ((idx = rtnl_ifindex(h,name)) < 0)
+    return idx;
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  req.n.nlmsg_type = cmd;
+  if (cmd == RTM_NEWADDR)
+    req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+  req.a.ifa_family = AF_INET;
+  req.a.ifa_prefixlen = prefixlen;
+  req.a.ifa_index = idx;
+
+  err |= addattr_l(REQ_MSG(req),IFA_LOCAL,&addr,sizeof(addr));
+  err |= addattr_l(REQ_MSG(req),IFA_ADDRESS,&addr,sizeof(addr));
+  if (brd)
+    err |= addattr_l(REQ_MSG(req),IFA_BROADCAST,brd,sizeof(*brd));
+  if (label)
+    err |= addattr_str(REQ_MSG(req),IFA_LABEL,label);
+
+  if (err)
+    return -EMSGSIZE;
+
+  inet_ntop(AF_INET,&addr,str,sizeof(str));
+  snprintf(desc,sizeof(desc),"addr %s %s/%u dev %s",
+    (cmd == RTM_NEWADDR ? "add" : "del"),str,prefixlen,name);
+  return rtnl_request(h,REQ_MSG(req),desc);
+}
+
+/* Permanent entries, an existing entry of dst is replaced */
+int rtnl_neigh(rtnl_handle *h, int cmd, const char *name, struct in_addr dst,
+  const unsigned char *lladdr, size_t lladdr_len)
+{
+  neigh_req req;
+  char desc[RTNL_DESCSIZE], str[INET_ADDRSTRLEN];
+  int err = 0, idx;
+
+  if ((idx = rtnl_ifindex(h,name)) < 0)
+    return idx;
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+  req.n.nlmsg_type = cmd;
+  if (cmd == RTM_NEWNEIGH)
+    req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+  req.nd.ndm_family = AF_INET;
+  req.nd.ndm_ifindex = idx;
+  req.nd.ndm_state = NUD_PERMANENT;
+
+  err |= addattr_l(REQ_MSG(req),NDA_DST,&dst,sizeof(dst));
+  if (lladdr)
+    err |= addattr_l(REQ_MSG(req),NDA_LLADDR,lladdr,lladdr_len);
+
+  if (err)
+    return -EMSGSIZE;
+
+  inet_ntop(AF_INET,&dst,str,sizeof(str));
+  snprintf(desc,sizeof(desc),"neigh %s %s dev %s",
+    (cmd == RTM_NEWNEIGH ? "replace" : "del"),str,name);
+  return rtnl_request(h,REQ_MSG(req),desc);
+}
+
+/* Send a dump request and call fn on every reply of type type. The queued
+ * requests are sent first so that the dump reflects them */
+static int rtnl_dump(rtnl_handle *h, struct nlmsghdr *req, int type,
+  rtnl_dump_fn fn, void *arg)
+{
+  struct nlmsghdr *n;
+  unsigned int seq;
+  ssize_t len;
+  int ret;
+
+  if ((ret = rtnl_commit(h)) < 0)
+    return ret;
+
+  req->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  req->nlmsg_seq = seq = ++h->seq;
+  if ((ret = rtnl_send(h,req,req->nlmsg_len)) < 0)
+    return ret;
+
+  /* the replies are read until the end even if fn fails, so that they do not
+   * mix with the ones of the next request */
+  while (1)
+  {
+    len = rtnl_recv(h);
+    if (len < 0)
+      return len;
+
+    for (n = (struct nlmsghdr *) h->rbuf; NLMSG_OK(n,len);
+      n = NLMSG_NEXT(n,len))
+    {
+      if (n->nlmsg_seq != seq)
+        continue;
+      if (n->nlmsg_type == NLMSG_DONE)
+        return ret;
+      if (n->nlmsg_type == NLMSG_ERROR)
+        return ((struct nlmsgerr *) NLMSG_DATA(n))->error;
+      if (n->nlmsg_type == type && !ret)
+        ret = fn(n,arg);
+    }
+  }
+}
+
+int rtnl_link_dump(rtnl_handle *h, rtnl_dump_fn fn, void *arg)
+{
+  link_req req;
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.n.nlmsg_type = RTM_GETLINK;
+  req.i.ifi_family = AF_UNSPEC;
+
+  return rtnl_dump(h,REQ_MSG(req),RTM_NEWLINK,fn,arg);
+}
+
+typedef struct {
+  int ifindex;
+  rtnl_dump_fn fn;
+  void *arg;
+} dump_filter;
+
+static int addr_filter(struct nlmsghdr *n, void *arg)
+{
+  dump_filter *f = (dump_filter *) arg;
+  struct ifaddrmsg *a = NLMSG_DATA(n);
+
+  if (f->ifindex && (int) a->ifa_index != f->ifindex)
+    return 0;
+  return f->fn(n,f->arg);
+}
+
+/* IPv4 addresses of an interface (of every interface if ifindex is 0) */
+int rtnl_addr_dump(rtnl_handle *h, int ifindex, rtnl_dump_fn fn, void *arg)
+{
+  addr_req req;
+  dump_filter f = { ifindex, fn, arg };
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  req.n.nlmsg_type = RTM_GETADDR;
+  req.a.ifa_family = AF_INET;
+
+  return rtnl_dump(h,REQ_MSG(req),RTM_NEWADDR,addr_filter,&f);
+}
+
+static int qdisc_filter(struct nlmsghdr *n, void *arg)
+{
+  dump_filter *f = (dump_filter *) arg;
+  struct tcmsg *t = NLMSG_DATA(n);
+
+  if (f->ifindex && t->tcm_ifindex != f->ifindex)
+    return 0;
+  return f->fn(n,f->arg);
+}
+
+/* Qdiscs of an interface (of every interface if ifindex is 0), recent
+ * kernels only send the ones of the interface */
+int rtnl_qdisc_dump(rtnl_handle *h, int ifindex, rtnl_dump_fn fn, void *arg)
+{
+  qdisc_req req;
+  dump_filter f = { ifindex, fn, arg };
+
+  memset(&req,0,sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+  req.n.nlmsg_type = RTM_GETQDISC;
+  req.t.tcm_family = AF_UNSPEC;
+  req.t.tcm_ifindex = ifindex;
+
+  return rtnl_dump(h,REQ_MSG(req),RTM_NEWQDISC,qdisc_filter,&f);
+}
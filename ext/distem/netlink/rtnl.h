@@ -0,0 +1,77 @@
+#ifndef _RTNL_H
+#define _RTNL_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * Minimal rtnetlink client for the link, address, neighbor and qdisc
+ * operations of Distem. In batch mode, the requests are queued and sent with a single
+ * sendmsg() when the batch is committed (or when the buffer is full), then
+ * the acknowledgements are matched back to the requests by sequence number.
+ */
+
+#define RTNL_BUFSIZE (64 * 1024)
+#define RTNL_REQSIZE 1024
+#define RTNL_DESCSIZE 64
+#define RTNL_MAX_PENDING 1024
+#define RTNL_ERRSIZE 1024
+
+typedef struct {
+  int fd;
+  unsigned int seq;
+  int batch;
+  int netns;       /* opened in another network namespace */
+  char last_name[IF_NAMESIZE]; /* the last interface looked up in it */
+  int last_index;
+  char *buf;       /* queued requests */
+  size_t len;
+  char *rbuf;      /* replies */
+  unsigned int pending;
+  unsigned int first_seq;
+  char descs[RTNL_MAX_PENDING][RTNL_DESCSIZE];
+  char error[RTNL_ERRSIZE]; /* the request(s) that failed */
+} rtnl_handle;
+
+/* Unset fields are 0 (or NULL) */
+typedef struct {
+  const char *peer;          /* veth */
+  unsigned int vxlan_id;     /* vxlan */
+  struct in_addr group;
+  unsigned int ttl;
+  const char *dev;
+  unsigned short port;
+  int forward_delay;         /* bridge, -1 if unset, in centiseconds */
+  long long ageing_time;     /* bridge, -1 if unset, in centiseconds */
+  unsigned int mtu;
+} rtnl_link_opts;
+
+typedef int (*rtnl_dump_fn)(struct nlmsghdr *n, void *arg);
+
+int rtnl_open(rtnl_handle *h);
+int rtnl_open_netns(rtnl_handle *h, const char *netns);
+void rtnl_close(rtnl_handle *h);
+int rtnl_commit(rtnl_handle *h);
+void rtnl_discard(rtnl_handle *h);
+int rtnl_ifindex(rtnl_handle *h, const char *name);
+
+int rtnl_link_add(rtnl_handle *h, const char *name, const char *kind,
+  const rtnl_link_opts *opts);
+int rtnl_link_del(rtnl_handle *h, const char *name);
+int rtnl_link_set(rtnl_handle *h, const char *name, unsigned int change,
+  unsigned int flags, const char *master, unsigned int mtu);
+int rtnl_addr(rtnl_handle *h, int cmd, const char *name, struct in_addr addr,
+  unsigned char prefixlen, const struct in_addr *brd, const char *label);
+int rtnl_neigh(rtnl_handle *h, int cmd, const char *name, struct in_addr dst,
+  const unsigned char *lladdr, size_t lladdr_len);
+
+int rtnl_link_dump(rtnl_handle *h, rtnl_dump_fn fn, void *arg);
+int rtnl_addr_dump(rtnl_handle *h, int ifindex, rtnl_dump_fn fn, void *arg);
+int rtnl_qdisc_dump(rtnl_handle *h, int ifindex, rtnl_dump_fn fn, void *arg);
+
+struct rtattr *rtnl_attr(struct rtattr *rta, int len, int type);
+
+#endif
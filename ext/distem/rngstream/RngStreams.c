@@ -0,0 +1,255 @@
+/*
+ * Multi-stream MRG32k3a engine: advances N streams in lockstep, 4 (AVX2) or
+ * 2 (SSE4.1) streams per vector, with a scalar fallback.
+ *
+ * Every intermediate value of the recurrence is an integer lower than 2^53,
+ * so the double precision arithmetic is exact and the vector engines give
+ * the very same numbers as RngStream.c.
+ */
+
+#include "RngStreams.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RNGSTREAMS_X86 1
+#include <immintrin.h>
+#endif
+
+#define norm  2.328306549295727688e-10
+#define m1    4294967087.0
+#define m2    4294944443.0
+#define a12     1403580.0
+#define a13n     810728.0
+#define a21      527612.0
+#define a23n    1370589.0
+
+
+/*-------------------------------------------------------------------------*/
+
+RngStreams RngStreams_Create (long n)
+{
+   RngStreams g;
+   RngStream s;
+   long i;
+   int j;
+
+   g = (RngStreams) calloc (1, sizeof (struct RngStreams_InfoState));
+   if (g == NULL)
+      return NULL;
+   g->n = n;
+   g->engine = RngStreams_BestEngine ();
+   g->Cg[0] = (double *) malloc (6 * (n > 0 ? n : 1) * sizeof (double));
+   if (g->Cg[0] == NULL) {
+      free (g);
+      return NULL;
+   }
+   for (j = 1; j < 6; ++j)
+      g->Cg[j] = g->Cg[0] + j * n;
+
+   for (i = 0; i < n; ++i) {
+      s = RngStream_CreateStream (NULL);
+      for (j = 0; j < 6; ++j)
+         g->Cg[j][i] = s->Cg[j];
+      RngStream_DeleteStream (&s);
+   }
+   return g;
+}
+
+/*-------------------------------------------------------------------------*/
+
+void RngStreams_Delete (RngStreams *pg)
+{
+   if (*pg == NULL)
+      return;
+   free ((*pg)->Cg[0]);
+   free (*pg);
+   *pg = NULL;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int RngStreams_SetSeed (RngStreams g, unsigned long seed[6])
+{
+   RngStream s;
+   long i;
+   int j;
+
+   s = RngStream_CreateStream (NULL);
+   if (RngStream_SetSeed (s, seed)) {
+      RngStream_DeleteStream (&s);
+      return -1;
+   }
+   for (i = 0; i < g->n; ++i) {
+      for (j = 0; j < 6; ++j)
+         g->Cg[j][i] = s->Cg[j];
+      RngStream_AdvanceState (s, 127, 0);
+   }
+   RngStream_DeleteStream (&s);
+   return 0;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int RngStreams_BestEngine (void)
+{
+#ifdef RNGSTREAMS_X86
+   __builtin_cpu_init ();
+   if (__builtin_cpu_supports ("avx2"))
+      return RNGSTREAMS_AVX2;
+   if (__builtin_cpu_supports ("sse4.1"))
+      return RNGSTREAMS_SSE41;
+#endif
+   return RNGSTREAMS_SCALAR;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int RngStreams_SetEngine (RngStreams g, int engine)
+{
+   if (engine < RNGSTREAMS_SCALAR || engine > RngStreams_BestEngine ())
+      return 0;
+   g->engine = engine;
+   return 1;
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* Same computation as U01 in RngStream.c, for the streams [from, to[ */
+static void RandU01_scalar (RngStreams g, long from, long to, long m,
+   double *u)
+{
+   long i, j, k;
+   double p1, p2, c0, c1, c2, c3, c4, c5;
+
+   for (i = from; i < to; ++i) {
+      c0 = g->Cg[0][i]; c1 = g->Cg[1][i]; c2 = g->Cg[2][i];
+      c3 = g->Cg[3][i]; c4 = g->Cg[4][i]; c5 = g->Cg[5][i];
+      for (j = 0; j < m; ++j) {
+         p1 = a12 * c1 - a13n * c0;
+         k = p1 / m1;
+         p1 -= k * m1;
+         if (p1 < 0.0)
+            p1 += m1;
+         c0 = c1; c1 = c2; c2 = p1;
+
+         p2 = a21 * c5 - a23n * c3;
+         k = p2 / m2;
+         p2 -= k * m2;
+         if (p2 < 0.0)
+            p2 += m2;
+         c3 = c4; c4 = c5; c5 = p2;
+
+         u[j * g->n + i] = ((p1 > p2) ? (p1 - p2) * norm : (p1 - p2 + m1) * norm);
+      }
+      g->Cg[0][i] = c0; g->Cg[1][i] = c1; g->Cg[2][i] = c2;
+      g->Cg[3][i] = c3; g->Cg[4][i] = c4; g->Cg[5][i] = c5;
+   }
+}
+
+#ifdef RNGSTREAMS_X86
+
+/*-------------------------------------------------------------------------*/
+
+__attribute__ ((target ("avx2")))
+static long RandU01_avx2 (RngStreams g, long m, double *u)
+{
+   long i, j, n = g->n;
+   const __m256d vm1 = _mm256_set1_pd (m1), vm2 = _mm256_set1_pd (m2);
+   const __m256d va12 = _mm256_set1_pd (a12), va13n = _mm256_set1_pd (a13n);
+   const __m256d va21 = _mm256_set1_pd (a21), va23n = _mm256_set1_pd (a23n);
+   const __m256d vnorm = _mm256_set1_pd (norm), zero = _mm256_setzero_pd ();
+   __m256d c0, c1, c2, c3, c4, c5, p1, p2, k, d;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      c0 = _mm256_loadu_pd (&g->Cg[0][i]); c1 = _mm256_loadu_pd (&g->Cg[1][i]);
+      c2 = _mm256_loadu_pd (&g->Cg[2][i]); c3 = _mm256_loadu_pd (&g->Cg[3][i]);
+      c4 = _mm256_loadu_pd (&g->Cg[4][i]); c5 = _mm256_loadu_pd (&g->Cg[5][i]);
+      for (j = 0; j < m; ++j) {
+         p1 = _mm256_sub_pd (_mm256_mul_pd (va12, c1), _mm256_mul_pd (va13n, c0));
+         k = _mm256_round_pd (_mm256_div_pd (p1, vm1),
+            _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+         p1 = _mm256_sub_pd (p1, _mm256_mul_pd (k, vm1));
+         p1 = _mm256_add_pd (p1,
+            _mm256_and_pd (_mm256_cmp_pd (p1, zero, _CMP_LT_OQ), vm1));
+         c0 = c1; c1 = c2; c2 = p1;
+
+         p2 = _mm256_sub_pd (_mm256_mul_pd (va21, c5), _mm256_mul_pd (va23n, c3));
+         k = _mm256_round_pd (_mm256_div_pd (p2, vm2),
+            _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+         p2 = _mm256_sub_pd (p2, _mm256_mul_pd (k, vm2));
+         p2 = _mm256_add_pd (p2,
+            _mm256_and_pd (_mm256_cmp_pd (p2, zero, _CMP_LT_OQ), vm2));
+         c3 = c4; c4 = c5; c5 = p2;
+
+         d = _mm256_sub_pd (p1, p2);
+         d = _mm256_add_pd (d,
+            _mm256_and_pd (_mm256_cmp_pd (p1, p2, _CMP_LE_OQ), vm1));
+         _mm256_storeu_pd (&u[j * n + i], _mm256_mul_pd (d, vnorm));
+      }
+      _mm256_storeu_pd (&g->Cg[0][i], c0); _mm256_storeu_pd (&g->Cg[1][i], c1);
+      _mm256_storeu_pd (&g->Cg[2][i], c2); _mm256_storeu_pd (&g->Cg[3][i], c3);
+      _mm256_storeu_pd (&g->Cg[4][i], c4); _mm256_storeu_pd (&g->Cg[5][i], c5);
+   }
+   return i;
+}
+
+/*-------------------------------------------------------------------------*/
+
+__attribute__ ((target ("sse4.1")))
+static long RandU01_sse41 (RngStreams g, long m, double *u)
+{
+   long i, j, n = g->n;
+   const __m128d vm1 = _mm_set1_pd (m1), vm2 = _mm_set1_pd (m2);
+   const __m128d va12 = _mm_set1_pd (a12), va13n = _mm_set1_pd (a13n);
+   const __m128d va21 = _mm_set1_pd (a21), va23n = _mm_set1_pd (a23n);
+   const __m128d vnorm = _mm_set1_pd (norm), zero = _mm_setzero_pd ();
+   __m128d c0, c1, c2, c3, c4, c5, p1, p2, k, d;
+
+   for (i = 0; i + 2 <= n; i += 2) {
+      c0 = _mm_loadu_pd (&g->Cg[0][i]); c1 = _mm_loadu_pd (&g->Cg[1][i]);
+      c2 = _mm_loadu_pd (&g->Cg[2][i]); c3 = _mm_loadu_pd (&g->Cg[3][i]);
+      c4 = _mm_loadu_pd (&g->Cg[4][i]); c5 = _mm_loadu_pd (&g->Cg[5][i]);
+      for (j = 0; j < m; ++j) {
+         p1 = _mm_sub_pd (_mm_mul_pd (va12, c1), _mm_mul_pd (va13n, c0));
+         k = _mm_round_pd (_mm_div_pd (p1, vm1),
+            _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+         p1 = _mm_sub_pd (p1, _mm_mul_pd (k, vm1));
+         p1 = _mm_add_pd (p1, _mm_and_pd (_mm_cmplt_pd (p1, zero), vm1));
+         c0 = c1; c1 = c2; c2 = p1;
+
+         p2 = _mm_sub_pd (_mm_mul_pd (va21, c5), _mm_mul_pd (va23n, c3));
+         k = _mm_round_pd (_mm_div_pd (p2, vm2),
+            _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+         p2 = _mm_sub_pd (p2, _mm_mul_pd (k, vm2));
+         p2 = _mm_add_pd (p2, _mm_and_pd (_mm_cmplt_pd (p2, zero), vm2));
+         c3 = c4; c4 = c5; c5 = p2;
+
+         d = _mm_sub_pd (p1, p2);
+         d = _mm_add_pd (d, _mm_and_pd (_mm_cmple_pd (p1, p2), vm1));
+         _mm_storeu_pd (&u[j * n + i], _mm_mul_pd (d, vnorm));
+      }
+      _mm_storeu_pd (&g->Cg[0][i], c0); _mm_storeu_pd (&g->Cg[1][i], c1);
+      _mm_storeu_pd (&g->Cg[2][i], c2); _mm_storeu_pd (&g->Cg[3][i], c3);
+      _mm_storeu_pd (&g->Cg[4][i], c4); _mm_storeu_pd (&g->Cg[5][i], c5);
+   }
+   return i;
+}
+
+#endif
+
+/*-------------------------------------------------------------------------*/
+
+void RngStreams_RandU01 (RngStreams g, long m, double *u)
+{
+   long done = 0;
+
+#ifdef RNGSTREAMS_X86
+   if (g->engine == RNGSTREAMS_AVX2)
+      done = RandU01_avx2 (g, m, u);
+   else if (g->engine == RNGSTREAMS_SSE41)
+      done = RandU01_sse41 (g, m, u);
+#endif
+   /* remaining streams that do not fill a vector */
+   RandU01_scalar (g, done, g->n, m, u);
+}
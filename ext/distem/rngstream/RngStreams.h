@@ -0,0 +1,46 @@
+/* RngStreams.h: N independent MRG32k3a streams advanced in lockstep */
+#ifndef RNGSTREAMS_H
+#define RNGSTREAMS_H
+
+#include "RngStream.h"
+
+#define RNGSTREAMS_SCALAR 0
+#define RNGSTREAMS_SSE41 1
+#define RNGSTREAMS_AVX2 2
+
+typedef struct RngStreams_InfoState * RngStreams;
+
+struct RngStreams_InfoState {
+   long n;
+   int engine;
+   double *Cg[6];   /* Cg[j][i]: component j of the state of stream i */
+};
+
+
+/* Creates n streams, they get the same seeds as n successive calls to
+   RngStream_CreateStream */
+RngStreams RngStreams_Create (long n);
+
+
+void RngStreams_Delete (RngStreams *pg);
+
+
+/* The first stream is set to seed, the others are spaced by 2^127 */
+int RngStreams_SetSeed (RngStreams g, unsigned long seed[6]);
+
+
+/* Best engine available on this CPU */
+int RngStreams_BestEngine (void);
+
+
+/* Returns 0 if the engine is not available on this CPU */
+int RngStreams_SetEngine (RngStreams g, int engine);
+
+
+/* Draws m numbers from each stream. The jth number of the stream i is
+   stored in u[j*n + i]. The values are bit-identical to the ones of
+   RngStream_RandU01 (without antithetic or increased precision). */
+void RngStreams_RandU01 (RngStreams g, long m, double *u);
+
+
+#endif
@@ -1,3 +1,5 @@
+#include <math.h>
+#include <string.h>
 #include "main.h"
 
 /*
@@ -7,21 +9,62 @@
 
 VALUE m_random = Qnil;
 VALUE c_rngstream = Qnil;
+VALUE c_rngstreams = Qnil;
+
+static const char *engines[] = { "scalar", "sse4.1", "avx2" };
+
+static const rb_data_type_t rng_type = {
+  "RandomExtension::RngStream",
+  { 0, rng_free, 0, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static const rb_data_type_t rngs_type = {
+  "RandomExtension::RngStreams",
+  { 0, rngs_free, 0, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static RngStream get_stream(VALUE self) {
+  RngStream stream;
+  TypedData_Get_Struct(self, struct RngStream_InfoState, &rng_type, stream);
+  return stream;
+}
 
 void Init_rngstream() {
   m_random = rb_define_module("RandomExtension");
   c_rngstream = rb_define_class_under(m_random, "RngStream", rb_cObject);
+  rb_define_alloc_func(c_rngstream, rng_alloc);
   rb_define_method(c_rngstream, "initialize", rng_initialize, 0);
   rb_define_method(c_rngstream, "set_seed", rng_set_seed, 1);
   rb_define_method(c_rngstream, "randU01", rng_get_rand, 0);
+  rb_define_method(c_rngstream, "fill_u01", rng_fill_u01, 1);
+  rb_define_method(c_rngstream, "sample", rng_sample, 3);
   rb_define_method(c_rngstream, "advance_state", rng_advance_state, 1);
-  rb_define_attr(c_rngstream, "stream_prt", 0, 0);
+
+  c_rngstreams = rb_define_class_under(m_random, "RngStreams", rb_cObject);
+  rb_define_alloc_func(c_rngstreams, rngs_alloc);
+  rb_define_method(c_rngstreams, "initialize", rngs_initialize, 1);
+  rb_define_method(c_rngstreams, "set_seed", rngs_set_seed, 1);
+  rb_define_method(c_rngstreams, "size", rngs_size, 0);
+  rb_define_method(c_rngstreams, "engine", rngs_get_engine, 0);
+  rb_define_method(c_rngstreams, "engine=", rngs_set_engine, 1);
+  rb_define_method(c_rngstreams, "fill_u01", rngs_fill_u01, 1);
 }
 
-VALUE rng_initialize(VALUE self) {
+// the stream is created with the object, so that there is no need to fetch
+// it from an instance variable on every call
+VALUE rng_alloc(VALUE klass) {
   RngStream stream = RngStream_CreateStream(NULL);
-  VALUE stream_ptr = Data_Wrap_Struct(rb_cObject, 0, rng_free, (void*) stream);
-  rb_iv_set(self, "@stream_prt", stream_ptr);
+  if (!stream) {
+    rb_raise(rb_eNoMemError, "Cannot create the stream");
+  }
+  return TypedData_Wrap_Struct(klass, &rng_type, (void*) stream);
+}
+
+VALUE rng_initialize(VALUE self) {
   return self;
 }
 
@@ -38,9 +81,7 @@ VALUE rng_set_seed(VALUE self, VALUE seed) {
   for(i=0 ; i<6 ; i++) {
     seed_arr[i] = NUM2ULONG(rb_ary_entry(seed, i));
   }
-  VALUE stream_ptr = rb_iv_get(self, "@stream_prt");
-  RngStream stream;
-  Data_Get_Struct(stream_ptr, RngStream, stream);
+  RngStream stream = get_stream(self);
 
   int error = RngStream_SetSeed(stream, seed_arr);
   if(error) {
@@ -51,17 +92,184 @@ VALUE rng_set_seed(VALUE self, VALUE seed) {
 }
 
 VALUE rng_get_rand(VALUE self) {
-  VALUE stream_ptr = rb_iv_get(self, "@stream_prt");
-  RngStream stream;
-  Data_Get_Struct(stream_ptr, RngStream, stream);
-  double rand_value = RngStream_RandU01(stream);
+  double rand_value = RngStream_RandU01(get_stream(self));
   return rb_float_new(rand_value);
 }
 
+static VALUE new_buffer(long n, double **values) {
+  VALUE buffer;
+
+  if (n < 0) {
+    rb_raise(rb_eArgError, "Negative number of values");
+  }
+  buffer = rb_str_new(NULL, n * sizeof(double));
+  *values = (double*) RSTRING_PTR(buffer);
+  return buffer;
+}
+
+// get a parameter of a distribution, params keys can be Strings or Symbols
+static double get_param(VALUE params, const char *name) {
+  VALUE val = rb_hash_lookup2(params, rb_str_new2(name), Qundef);
+  if (val == Qundef) {
+    val = rb_hash_lookup2(params, ID2SYM(rb_intern(name)), Qundef);
+  }
+  if (val == Qundef || NIL_P(val)) {
+    rb_raise(rb_eArgError, "Missing parameter '%s'", name);
+  }
+  return NUM2DBL(rb_funcall(val, rb_intern("to_f"), 0));
+}
+
+// n values uniformly distributed in ]0,1[, returned as a String of native
+// doubles (use unpack('d*') to get them as an Array)
+VALUE rng_fill_u01(VALUE self, VALUE n) {
+  RngStream stream = get_stream(self);
+  long i, nb = NUM2LONG(n);
+  double *values;
+  VALUE buffer = new_buffer(nb, &values);
+
+  for (i = 0; i < nb; i++) {
+    values[i] = RngStream_RandU01(stream);
+  }
+  return buffer;
+}
+
+// n values following one of the distributions supported by the event
+// generators (uniform, exponential, weibull), returned as a String of native
+// doubles. The computations are the same as the ones done in Ruby, so the
+// values are identical.
+VALUE rng_sample(VALUE self, VALUE distribution, VALUE params, VALUE n) {
+  RngStream stream = get_stream(self);
+  long i, nb = NUM2LONG(n);
+  double *values;
+  const char *dist;
+  VALUE buffer;
+
+  if (SYMBOL_P(distribution)) {
+    distribution = rb_sym2str(distribution);
+  }
+  dist = StringValueCStr(distribution);
+  Check_Type(params, T_HASH);
+
+  if (!strcmp(dist, "uniform")) {
+    double min = get_param(params, "min");
+    double max = get_param(params, "max");
+    buffer = new_buffer(nb, &values);
+    for (i = 0; i < nb; i++) {
+      values[i] = min + (max - min) * RngStream_RandU01(stream);
+    }
+  } else if (!strcmp(dist, "exponential")) {
+    double rate = get_param(params, "rate");
+    buffer = new_buffer(nb, &values);
+    for (i = 0; i < nb; i++) {
+      values[i] = -log(RngStream_RandU01(stream)) / rate;
+    }
+  } else if (!strcmp(dist, "weibull")) {
+    double scale = get_param(params, "scale");
+    double shape = get_param(params, "shape");
+    buffer = new_buffer(nb, &values);
+    for (i = 0; i < nb; i++) {
+      values[i] = scale * pow(-log(RngStream_RandU01(stream)), 1.0 / shape);
+    }
+  } else {
+    rb_raise(rb_eArgError, "Probabilist distribution not supported : %s", dist);
+  }
+
+  return buffer;
+}
+
 VALUE rng_advance_state(VALUE self, VALUE dispacement) {
-  VALUE stream_ptr = rb_iv_get(self, "@stream_prt");
-  RngStream stream;
-  Data_Get_Struct(stream_ptr, RngStream, stream);
-  RngStream_AdvanceState(stream, 0, FIX2LONG(dispacement));
+  RngStream_AdvanceState(get_stream(self), 0, NUM2LONG(dispacement));
+  return self;
+}
+
+// RngStreams: n streams advanced in lockstep (see RngStreams.h)
+
+static RngStreams get_streams(VALUE self) {
+  RngStreams streams;
+  TypedData_Get_Struct(self, struct RngStreams_InfoState, &rngs_type, streams);
+  if (!streams) {
+    rb_raise(rb_eRuntimeError, "Uninitialized streams");
+  }
+  return streams;
+}
+
+VALUE rngs_alloc(VALUE klass) {
+  return TypedData_Wrap_Struct(klass, &rngs_type, NULL);
+}
+
+VALUE rngs_initialize(VALUE self, VALUE n) {
+  long nb = NUM2LONG(n);
+  RngStreams streams;
+
+  if (nb <= 0) {
+    rb_raise(rb_eArgError, "Invalid number of streams");
+  }
+  if (DATA_PTR(self)) {
+    rb_raise(rb_eRuntimeError, "Already initialized");
+  }
+  streams = RngStreams_Create(nb);
+  if (!streams) {
+    rb_raise(rb_eNoMemError, "Cannot create the streams");
+  }
+  DATA_PTR(self) = streams;
   return self;
 }
+
+void rngs_free(void* ptr) {
+  RngStreams streams = (RngStreams) ptr;
+  RngStreams_Delete(&streams);
+}
+
+// seed MUST be an array of at least 6 numbers, or you will get a segfault !
+VALUE rngs_set_seed(VALUE self, VALUE seed) {
+  unsigned long seed_arr[6];
+  int i;
+
+  for(i=0 ; i<6 ; i++) {
+    seed_arr[i] = NUM2ULONG(rb_ary_entry(seed, i));
+  }
+  if (RngStreams_SetSeed(get_streams(self), seed_arr)) {
+    rb_raise(rb_eArgError, "Invalid seed");
+  }
+  return self;
+}
+
+VALUE rngs_size(VALUE self) {
+  return LONG2NUM(get_streams(self)->n);
+}
+
+VALUE rngs_get_engine(VALUE self) {
+  return rb_str_new2(engines[get_streams(self)->engine]);
+}
+
+VALUE rngs_set_engine(VALUE self, VALUE engine) {
+  int i;
+  const char *name = StringValueCStr(engine);
+
+  for (i = 0; i < (int) (sizeof(engines) / sizeof(engines[0])); i++) {
+    if (!strcmp(name, engines[i])) {
+      if (!RngStreams_SetEngine(get_streams(self), i)) {
+        rb_raise(rb_eArgError, "Engine not supported by this CPU : %s", name);
+      }
+      return engine;
+    }
+  }
+  rb_raise(rb_eArgError, "Unknown engine : %s", name);
+  return Qnil;
+}
+
+// m values from each stream, as a String of native doubles: the jth value of
+// the stream i is at index j*size + i
+VALUE rngs_fill_u01(VALUE self, VALUE m) {
+  RngStreams streams = get_streams(self);
+  long nb = NUM2LONG(m);
+  double *values;
+  VALUE buffer;
+
+  if (nb < 0 || (streams->n && nb > LONG_MAX / (long) sizeof(double) / streams->n)) {
+    rb_raise(rb_eArgError, "Invalid number of values");
+  }
+  buffer = new_buffer(nb * streams->n, &values);
+  RngStreams_RandU01(streams, nb, values);
+  return buffer;
+}
@@ -1,14 +1,37 @@
 #include "ruby.h"
 #include "RngStream.h"
+#include "RngStreams.h"
 
 void Init_rngstream();
 
+VALUE rng_alloc(VALUE klass);
+
 VALUE rng_initialize(VALUE self);
 
 VALUE rng_set_seed(VALUE self, VALUE seed);
 
 VALUE rng_get_rand(VALUE self);
 
+VALUE rng_fill_u01(VALUE self, VALUE n);
+
+VALUE rng_sample(VALUE self, VALUE distribution, VALUE params, VALUE n);
+
 VALUE rng_advance_state(VALUE self, VALUE dispacement);
 
 void rng_free(void* ptr);
+
+VALUE rngs_alloc(VALUE klass);
+
+VALUE rngs_initialize(VALUE self, VALUE n);
+
+VALUE rngs_set_seed(VALUE self, VALUE seed);
+
+VALUE rngs_size(VALUE self);
+
+VALUE rngs_get_engine(VALUE self);
+
+VALUE rngs_set_engine(VALUE self, VALUE engine);
+
+VALUE rngs_fill_u01(VALUE self, VALUE m);
+
+void rngs_free(void* ptr);
@@ -1,9 +1,15 @@
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
 #include "cpubench.h"
 
 
@@ -32,6 +38,9 @@ int timeval_subtract (result, x, y)
 	return x->tv_sec < y->tv_sec;
 }
 
+/* Keeps the compiler from optimizing the loop away */
+volatile int loop_sink;
+
 __inline__ void
 loop()
 {
@@ -41,6 +50,7 @@ loop()
         for (i=0; i < 1000; i++)
                 for (j=0; j < 100; j++)
                         x ^= x + (i & j);
+	loop_sink = x;
 }
 
 __inline__ void
@@ -173,25 +183,342 @@ double bench(unsigned int procnb, unsigned long long loopbase)
 	return (loopbase / walltime);
 }
 
+static size_t mem_size = DEFAULT_MEM_SIZE * 1024UL;
+static size_t cache_size = DEFAULT_CACHE_SIZE * 1024UL;
+
+static size_t kernel_mem_size(void)
+{
+	return mem_size;
+}
+
+static size_t kernel_cache_size(void)
+{
+	return cache_size;
+}
+
+static unsigned long long kernel_cpu(struct worker *w)
+{
+	(void) w;
+	loop();
+	return 1;
+}
+
+/* Read and write every word of the buffer, sequentially */
+static unsigned long long kernel_stream(struct worker *w)
+{
+	unsigned long *p, *end;
+	size_t n;
+
+	n = KERNEL_CHUNK;
+	if (n > w->len - w->pos)
+		n = w->len - w->pos;
+	p = w->buf + w->pos;
+	end = p + n;
+	while (p < end)
+		*p++ += 1;
+	w->pos += n;
+	if (w->pos >= w->len)
+		w->pos = 0;
+
+	return n * sizeof(unsigned long);
+}
+
+/* Each load depends on the previous one, so this measures the latency */
+static unsigned long long kernel_chase(struct worker *w)
+{
+	unsigned long *buf;
+	size_t pos;
+	unsigned int i;
+
+	buf = w->buf;
+	pos = w->pos;
+	for (i = 0; i < KERNEL_CHUNK; i++)
+		pos = buf[pos];
+	w->pos = pos;
+
+	return KERNEL_CHUNK;
+}
+
+static const struct kernel kernels[KERNEL_NB] = {
+	[KERNEL_CPU] = { "cpu", "loops", NULL, kernel_cpu },
+	[KERNEL_MEM] = { "mem", "bytes", kernel_mem_size, kernel_stream },
+	[KERNEL_CHASE] = { "chase", "loads", kernel_mem_size, kernel_chase },
+	[KERNEL_CACHE] = { "cache", "bytes", kernel_cache_size, kernel_stream },
+};
+
+int parse_kernel(const char *name)
+{
+	int i;
+
+	for (i = 0; i < KERNEL_NB; i++)
+		if (!strcmp(kernels[i].name,name))
+			return i;
+
+	return -1;
+}
+
+/* Parse a list of cores such as "0,2,4-7:mem", the kernel of the cores
+ * without suffix is set to -1 */
+int parse_cores(char *str, unsigned int *cores, int *kerns, unsigned int max)
+{
+	char *tok, *save, *end;
+	unsigned long first, last;
+	unsigned int nb;
+	int kernel;
+
+	nb = 0;
+	for (tok = strtok_r(str,",",&save); tok; tok = strtok_r(NULL,",",&save))
+	{
+		first = strtoul(tok,&end,10);
+		if (end == tok)
+			return -1;
+		last = first;
+		if (*end == '-')
+		{
+			tok = end + 1;
+			last = strtoul(tok,&end,10);
+			if ((end == tok) || (last < first))
+				return -1;
+		}
+		kernel = -1;
+		if ((*end == ':') && ((kernel = parse_kernel(end + 1)) < 0))
+			return -1;
+		else if ((*end != ':') && (*end != '\0'))
+			return -1;
+		while (first <= last)
+		{
+			if (nb >= max)
+				return -1;
+			kerns[nb] = kernel;
+			cores[nb++] = first++;
+		}
+	}
+
+	return nb;
+}
+
+/* Link the words of the buffer (one per cache line) in a single random cycle
+ * (Sattolo's algorithm) so that the hardware prefetchers cannot help */
+static void chase_init(struct worker *w)
+{
+	size_t i, j, tmp, step, nb;
+	unsigned long *order;
+	unsigned int seed;
+
+	step = CACHELINE_SIZE / sizeof(unsigned long);
+	nb = w->len / step;
+	order = malloc(nb * sizeof(*order));
+	if (!order)
+	{
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < nb; i++)
+		order[i] = i * step;
+	seed = w->core;
+	for (i = nb - 1; i > 0; i--)
+	{
+		j = rand_r(&seed) % i;
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (i = 0; i < nb; i++)
+		w->buf[order[i]] = order[(i + 1) % nb];
+	free(order);
+}
+
+/* The buffer is allocated and initialized by the worker itself, once pinned,
+ * so that it is located on the memory node of its core */
+static void worker_init(struct worker *w)
+{
+	size_t size;
+
+	if (!kernels[w->kernel].size)
+		return;
+
+	size = kernels[w->kernel].size();
+	if (size < 2 * CACHELINE_SIZE)
+		size = 2 * CACHELINE_SIZE;
+	if (posix_memalign((void **)&w->buf,CACHELINE_SIZE,size))
+	{
+		perror("posix_memalign");
+		exit(1);
+	}
+	w->len = size / sizeof(unsigned long);
+	memset(w->buf,0,size);
+	if (w->kernel == KERNEL_CHASE)
+		chase_init(w);
+}
+
+static volatile sig_atomic_t sampling = 1;
+
+static void sample_stop(int sig)
+{
+	(void) sig;
+	sampling = 0;
+}
+
+static pthread_barrier_t start_barrier;
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long long (*run)(struct worker *) = kernels[w->kernel].run;
+
+	worker_init(w);
+	pthread_barrier_wait(&start_barrier);
+	while (sampling)
+		__atomic_store_n(&w->loops,w->loops + run(w),__ATOMIC_RELAXED);
+	free(w->buf);
+
+	return NULL;
+}
+
+static inline double timespec2double(struct timespec *ts)
+{
+	return ((double) ts->tv_sec) + (((double) ts->tv_nsec) * 1e-9);
+}
+
+/* Run one worker pinned on each core and print, every resolution seconds, the
+ * throughput (work units of its kernel per second) achieved by each worker
+ * during the last period. The sampling starts once every worker is ready.
+ * Runs for duration seconds, or until SIGINT/SIGTERM if duration is 0 */
+void sample(unsigned int *cores, int *kerns, unsigned int corenb, double resolution, double duration)
+{
+	struct worker *workers;
+	unsigned long long *prev, cur;
+	struct timespec start, deadline, now;
+	double elapsed, last;
+	cpu_set_t cpuset;
+	pthread_attr_t attr;
+	unsigned int i;
+	long long step;
+
+	signal(SIGINT,sample_stop);
+	signal(SIGTERM,sample_stop);
+	setvbuf(stdout,NULL,_IOLBF,0);
+
+	if (posix_memalign((void **)&workers,CACHELINE_SIZE,corenb * sizeof(struct worker)))
+	{
+		perror("posix_memalign");
+		exit(1);
+	}
+	prev = calloc(corenb,sizeof(*prev));
+	memset(workers,0,corenb * sizeof(struct worker));
+
+	fprintf(stdout,"# cores:");
+	for (i = 0; i < corenb; i++)
+		fprintf(stdout," %u",cores[i]);
+	fprintf(stdout,"\n# kernels:");
+	for (i = 0; i < corenb; i++)
+		fprintf(stdout," %s",kernels[kerns[i]].name);
+	fprintf(stdout,"\n# units:");
+	for (i = 0; i < corenb; i++)
+		fprintf(stdout," %s",kernels[kerns[i]].unit);
+	fprintf(stdout,"\n");
+
+	pthread_barrier_init(&start_barrier,NULL,corenb + 1);
+	for (i = 0; i < corenb; i++)
+	{
+		workers[i].core = cores[i];
+		workers[i].kernel = kerns[i];
+		CPU_ZERO(&cpuset);
+		CPU_SET(cores[i],&cpuset);
+		pthread_attr_init(&attr);
+		if (pthread_attr_setaffinity_np(&attr,sizeof(cpuset),&cpuset)
+		|| pthread_create(&workers[i].thread,&attr,worker_fn,&workers[i]))
+		{
+			fprintf(stderr,"Cannot start a worker on core %u\n",cores[i]);
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+
+	/* The deadlines are absolute so that the sampling does not drift */
+	step = (long long) (resolution * 1e9);
+	pthread_barrier_wait(&start_barrier);
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	deadline = start;
+	last = 0.0;
+	while (sampling)
+	{
+		deadline.tv_nsec += step % 1000000000LL;
+		deadline.tv_sec += step / 1000000000LL + deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&deadline,NULL)
+		&& sampling);
+
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		elapsed = timespec2double(&now) - timespec2double(&start);
+		fprintf(stdout,"%.6f",elapsed);
+		for (i = 0; i < corenb; i++)
+		{
+			cur = __atomic_load_n(&workers[i].loops,__ATOMIC_RELAXED);
+			fprintf(stdout," %.1f",(cur - prev[i]) / (elapsed - last));
+			prev[i] = cur;
+		}
+		fprintf(stdout,"\n");
+		last = elapsed;
+
+		if ((duration > 0.0) && (elapsed >= duration))
+			sampling = 0;
+	}
+
+	for (i = 0; i < corenb; i++)
+		pthread_join(workers[i].thread,NULL);
+	pthread_barrier_destroy(&start_barrier);
+	free(prev);
+	free(workers);
+}
+
 int main(int argc, char **argv)
 {
 	int tmp;
 	unsigned int procnb, repeat;
 	unsigned long long int loopbase;
 	double result;
-	float time_base;
+	float time_base, resolution;
+	unsigned int cores[MAX_CORES];
+	int kerns[MAX_CORES];
+	int corenb, kernel;
+	char *corestr;
 
 	time_base = DEFAULT_TIME;
+	resolution = DEFAULT_RESOLUTION;
+	corestr = NULL;
+	kernel = KERNEL_CPU;
 	procnb = DEFAULT_PROCNB;
 	repeat = DEFAULT_REPEAT;
 
-	while ((tmp = getopt (argc, argv, "dn:p:t:")) != -1)
+	while ((tmp = getopt (argc, argv, "C:c:dk:m:n:p:r:t:")) != -1)
 	{
 		switch(tmp)
 		{
+		case 'C':
+			cache_size = strtoul(optarg,0,10) * 1024UL;
+			break;
+		case 'c':
+			corestr = optarg;
+			options |= OPT_SAMPLE;
+			break;
 		case 'd':
 			options |= OPT_DEBUG;
 			break;
+		case 'k':
+			kernel = parse_kernel(optarg);
+			if (kernel < 0)
+			{
+				fprintf (stderr, "Unknown kernel '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'm':
+			mem_size = strtoul(optarg,0,10) * 1024UL;
+			break;
+		case 'r':
+			resolution = strtof(optarg,0);
+			break;
 		case 'p':
 			procnb = strtol(optarg,0,10);
 			break;
@@ -202,7 +529,9 @@ int main(int argc, char **argv)
 			time_base = strtof(optarg,0);
 			break;
 		case '?':
-			if ((optopt == 'c') || (optopt == 'p') || (optopt == 'n'))
+			if ((optopt == 'c') || (optopt == 'p') || (optopt == 'n')
+			|| (optopt == 'r') || (optopt == 't') || (optopt == 'k')
+			|| (optopt == 'm') || (optopt == 'C'))
 				fprintf (stderr, "Option -%c requires an argument.\n", optopt);
 			else
 				fprintf (stderr, "Unknown option '-%c'.\n", optopt);
@@ -211,6 +540,28 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* Sampling mode: -t is the duration of the run (0 means until killed),
+	 * -k is the kernel of the cores without ":kernel" suffix in -c */
+	if (options & OPT_SAMPLE)
+	{
+		corenb = parse_cores(corestr,cores,kerns,MAX_CORES);
+		if (corenb <= 0)
+		{
+			fprintf (stderr, "Invalid list of cores '%s'.\n", corestr);
+			exit(1);
+		}
+		for (tmp = 0; tmp < corenb; tmp++)
+			if (kerns[tmp] < 0)
+				kerns[tmp] = kernel;
+		if (resolution <= 0.0f)
+		{
+			fprintf (stderr, "Invalid resolution.\n");
+			exit(1);
+		}
+		sample(cores,kerns,corenb,resolution,time_base);
+		return 0;
+	}
+
 	DEBUG("procs: %d\n",procnb);
 
 
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 char options = 0;
 
@@ -20,11 +21,53 @@ char options = 0;
 
 #define MAX_PROCNB 128
 
+#define DEFAULT_RESOLUTION 0.1f
+#define MAX_CORES 1024
+#define CACHELINE_SIZE 64
+
+/* Size of the buffer of the memory bound kernels (mem, chase) and of the cache
+ * resident one (cache), in KiB */
+#define DEFAULT_MEM_SIZE 65536
+#define DEFAULT_CACHE_SIZE 16
+/* Work done by a memory kernel between two updates of the counter */
+#define KERNEL_CHUNK 4096
+
 #define TIMEVAL2DOUBLE(T) (((double) (T).tv_sec) + (((double) (T).tv_usec) * 1e-6))
 
 enum options_val
 {
-	OPT_DEBUG = 1
+	OPT_DEBUG = 1,
+	OPT_SAMPLE = 2
+};
+
+enum kernel_val
+{
+	KERNEL_CPU = 0,    /* register only loop, counts loops */
+	KERNEL_MEM,        /* streams through a large buffer, counts bytes */
+	KERNEL_CHASE,      /* random pointer chasing in a large buffer, counts loads */
+	KERNEL_CACHE,      /* streams through a cache resident buffer, counts bytes */
+	KERNEL_NB
+};
+
+/* A worker pinned on a core, the counter is alone on its cache line to avoid
+ * false sharing between the workers */
+struct worker
+{
+	unsigned int core;
+	int kernel;
+	pthread_t thread;
+	unsigned long *buf;
+	size_t len;
+	size_t pos;
+	unsigned long long loops __attribute__((aligned(CACHELINE_SIZE)));
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+struct kernel
+{
+	const char *name;
+	const char *unit;
+	size_t (*size)(void);
+	unsigned long long (*run)(struct worker *w);
 };
 
 #define DEBUG(format,...) \
@@ -37,5 +80,8 @@ int timeval_subtract (struct timeval *result, struct timeval *x, struct timeval
 void loop();
 void loops(unsigned int times);
 unsigned long long int calibrate();
+int parse_kernel(const char *name);
+int parse_cores(char *str, unsigned int *cores, int *kernels, unsigned int max);
+void sample(unsigned int *cores, int *kernels, unsigned int corenb, double resolution, double duration);
 
 #endif
@@ -11,6 +11,7 @@ require 'distem/distemlib/memorytools'
 require 'distem/distemlib/filesystemtools'
 require 'distem/distemlib/validator'
 require 'distem/distemlib/synchronization'
+require 'distem/distemlib/portprober'
 require 'distem/resource/status'
 require 'distem/resource/vplatform'
 require 'distem/resource/pnode'
@@ -40,8 +41,13 @@ require 'distem/algorithm/algorithm'
 require 'distem/algorithm/cpu/cpu'
 require 'distem/algorithm/cpu/hogs'
 require 'distem/algorithm/cpu/gov'
+require 'distem/algorithm/cpu/quota'
+require 'distem/algorithm/network/network'
 require 'distem/algorithm/network/tcalgorithm'
 require 'distem/algorithm/network/tbf'
+require 'distem/algorithm/network/htbnetem'
+require 'distem/algorithm/network/ebpf'
+require 'distem/daemon/broadcast'
 require 'distem/daemon/distemcoordinator'
 require 'distem/daemon/distempnode'
 require 'distem/daemon/admin'
@@ -51,6 +57,9 @@ require 'distem/node/networkforge'
 require 'distem/node/cpuforge'
 require 'distem/node/filesystemforge'
 require 'distem/node/configmanager'
+require 'distem/node/executor'
+require 'distem/netapi/codec'
+require 'distem/netapi/connectionpool'
 require 'distem/netapi/client'
 require 'distem/netapi/server'
 require 'distem/topologystore/storebase'
@@ -65,6 +74,7 @@ require 'distem/wrapper/tc/wrapper'
 require 'distem/wrapper/tc/action'
 require 'distem/wrapper/tc/class'
 require 'distem/wrapper/tc/classhtb'
+require 'distem/wrapper/tc/classdrr'
 require 'distem/wrapper/tc/filter'
 require 'distem/wrapper/tc/filteru32'
 require 'distem/wrapper/tc/id'
@@ -73,15 +83,19 @@ require 'distem/wrapper/tc/qdiscroot'
 require 'distem/wrapper/tc/proto'
 require 'distem/wrapper/tc/qdisc'
 require 'distem/wrapper/tc/qdischtb'
+require 'distem/wrapper/tc/qdiscdrr'
 require 'distem/wrapper/tc/qdisctbf'
 require 'distem/wrapper/tc/qdiscnetem'
 require 'distem/wrapper/tc/qdiscprio'
 require 'distem/wrapper/tc/qdiscsfq'
 require 'distem/wrapper/tc/qdiscingress'
+require 'distem/wrapper/tc/qdiscclsact'
 require 'distem/wrapper/tc/netem'
+require 'distem/wrapper/tc/batch'
 require 'distem/cpugov'
 require 'distem/cpuhogs'
 require 'distem/rngstream'
+require 'distem/netlink'
 require 'distem/datacollection/collector'
 require 'distem/datacollection/probe'
 require 'distem/datacollection/probe_bw'
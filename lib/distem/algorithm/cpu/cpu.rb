@@ -4,6 +4,7 @@ module Distem
     module CPU
       GOV="gov"
       HOGS="hogs"
+      QUOTA="quota"
     end
   end
 end
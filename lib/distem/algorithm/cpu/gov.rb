@@ -11,12 +11,11 @@ module Distem
           @ext = nil
         end
 
-        # Apply the algorithm on a resource (virtual node)
+        # Apply the algorithm on a resource (virtual node). The vnode is registered to the governor of the physical node, or only updated if it is already handled by it on the same cores
         # ==== Attributes
         # * +vnode+ The VNode object
         #
         def apply(vnode)
-          super(vnode)
           cores = []
           freqmax = nil
           lfreq = nil
@@ -47,15 +46,28 @@ module Distem
             end
           end
 
-          unless cores.empty?
-            @ext = CPUExtension::CPUGov.new(
-              cores,freqmax,"#{Node::Admin::PATH_CGROUP}/#{vnode.name}"
-            )
+          if cores.empty?
+            undo(vnode)
+          else
             ratio = (wfreq.to_f - hfreq) / (lfreq - hfreq) unless ratio
-            @ext.run(lfreq.to_i,hfreq.to_i,ratio.to_f)
+            if @ext and @ext.running? and @ext.cores == cores
+              @ext.update(lfreq.to_i,hfreq.to_i,ratio.to_f)
+            else
+              undo(vnode)
+              @ext = CPUExtension::CPUGov.new(cores,freqmax,freezer_path(vnode))
+              @ext.run(lfreq.to_i,hfreq.to_i,ratio.to_f)
+            end
           end
         end
 
+        # Get the statistics of the transitions performed by the governor for this vnode
+        # ==== Returns
+        # Hash (transitions, transition_time and transition_max in seconds)
+        #
+        def stats
+          return (@ext ? @ext.stats : {})
+        end
+
         # Undo the algorithm on a resource (virtual node)
         # ==== Attributes
         # * +vnode+ The VNode object
@@ -67,6 +79,16 @@ module Distem
             @ext = nil
           end
         end
+
+        protected
+
+        # Get the cgroup directory used to freeze the vnode (cgroup.freeze on the unified hierarchy, the freezer controller otherwise)
+        def freezer_path(vnode)
+          path = LXCWrapper::Command.cgroup2_path(vnode.name)
+          path = nil if path and !File.exist?(File.join(path,'cgroup.freeze'))
+          path = LXCWrapper::Command.cgroup1_path(vnode.name,'freezer') unless path
+          return path.to_s
+        end
       end
 
     end
@@ -6,33 +6,52 @@ module Distem
       # Algorithm based on CPU burning methods. A process is launched in background and consume 100-wished_% percent of the core calculation resources i.e. if the cpu have to be set at 80% of this performancy, the algorithm will consume 20% permanently
       class Hogs < Algorithm
         # Create a new Hogs object
-        def initialize()
+        # ==== Attributes
+        # * +feedback+ Correct the amount of burnt CPU according to the measured usage of the cores
+        #
+        def initialize(feedback=true)
           super()
           @ext = nil
+          @cores = []
+          @feedback = feedback
         end
 
-        # Apply the algorithm on a resource (virtual node)
+        # Apply the algorithm on a resource (virtual node). If the hog process is already running on the same set of cores, the new ratios are pushed to it without restarting it
         # ==== Attributes
         # * +vnode+ The VNode object
         #
         def apply(vnode)
-          super(vnode)
           coresdesc = {}
 
           if vnode.vcpu and vnode.vcpu.vcores
             vnode.vcpu.vcores.each_value do |vcore|
-              coresdesc[vcore.pcore.physicalid.to_i] =
-                vcore.frequency.to_f / vcore.pcore.frequency.to_f if \
-                vcore.frequency < vcore.pcore.frequency
+              coresdesc[vcore.pcore.physicalid.to_i] = [
+                vcore.frequency.to_f / vcore.pcore.frequency.to_f, 1.0
+              ].min
             end
           end
 
-          unless coresdesc.empty?
-            @ext = CPUExtension::CPUHogs.new
-            @ext.run(coresdesc)
+          if @ext and @ext.running? and @cores == coresdesc.keys.sort
+            @ext.update(coresdesc)
+          else
+            undo(vnode)
+            if coresdesc.values.any? { |ratio| ratio < 1.0 }
+              @ext = CPUExtension::CPUHogs.new
+              @ext.feedback = @feedback
+              @ext.run(coresdesc)
+              @cores = coresdesc.keys.sort
+            end
           end
         end
 
+        # Get the requested and the measured ratio of each physical core
+        # ==== Returns
+        # Hash (key: core physical id, val: Hash with the 'requested' and 'achieved' ratios)
+        #
+        def stats
+          return (@ext ? @ext.stats : {})
+        end
+
         # Undo the algorithm on a resource (virtual node)
         # ==== Attributes
         # * +vnode+ The VNode object
@@ -42,6 +61,7 @@ module Distem
           if @ext
             @ext.stop
             @ext = nil
+            @cores = []
           end
         end
       end
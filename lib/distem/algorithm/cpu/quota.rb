@@ -0,0 +1,84 @@
+
+module Distem
+  module Algorithm
+    module CPU
+
+      # Algorithm based on the CPU bandwidth control of the cgroups. The virtual node is given a quota of CPU time per period, corresponding to the sum of the ratios of its cores i.e. if a vnode has two cores set at 60% of their frequency, it can use 2 * 0.6 * period of CPU time during each period. No core is burnt to emulate the frequency, and an update is a single write to the cgroup of the vnode.
+      class Quota < Algorithm
+        # The default period (in microseconds)
+        DEFAULT_PERIOD = 10000
+        # The minimal period allowed by the kernel (in microseconds)
+        MIN_PERIOD = 1000
+        # The maximal period allowed by the kernel (in microseconds)
+        MAX_PERIOD = 1000000
+
+        # The period the quota is computed on (in microseconds)
+        attr_reader :period
+
+        # Create a new Quota object
+        # ==== Attributes
+        # * +period+ The period of the bandwidth control, in microseconds
+        #
+        def initialize(period=DEFAULT_PERIOD)
+          super()
+          raise Lib::InvalidParameterError, period if \
+            period < MIN_PERIOD or period > MAX_PERIOD
+          @period = period.to_i
+          @path = nil
+        end
+
+        # Apply the algorithm on a resource (virtual node). The limits are updated in place, without removing the previous ones
+        # ==== Attributes
+        # * +vnode+ The VNode object
+        #
+        def apply(vnode)
+          ratios = []
+          if vnode.vcpu and vnode.vcpu.vcores
+            vnode.vcpu.vcores.each_value do |vcore|
+              ratios << [vcore.frequency.to_f / vcore.pcore.frequency.to_f, 1.0].min
+            end
+          end
+
+          if ratios.empty? or ratios.all? { |ratio| ratio >= 1.0 }
+            undo(vnode)
+          else
+            # The kernel does not accept quotas lower than 1ms
+            quota = [(ratios.inject(:+) * @period).round, MIN_PERIOD].max
+            set_limit(vnode, quota)
+          end
+        end
+
+        # Undo the algorithm on a resource (virtual node)
+        # ==== Attributes
+        # * +vnode+ The VNode object
+        #
+        def undo(vnode)
+          super(vnode)
+          set_limit(vnode, nil) if @path
+          @path = nil
+        end
+
+        protected
+
+        # Write the quota (nil for no limit) in the cgroup of the vnode
+        def set_limit(vnode, quota)
+          unless @path
+            #on the hybrid layout, the cpu controller is still on the v1 hierarchy
+            path = LXCWrapper::Command.cgroup2_path(vnode.name)
+            path = nil if path and !File.exist?(File.join(path,'cpu.max'))
+            @path = (path or :v1)
+          end
+          if @path == :v1
+            Lib::Shell.run("lxc-cgroup -n #{vnode.name} cpu.cfs_period_us #{@period}")
+            Lib::Shell.run("lxc-cgroup -n #{vnode.name} cpu.cfs_quota_us #{quota ? quota : -1}")
+          else
+            File.open(File.join(@path,'cpu.max'),'w') do |f|
+              f.syswrite("#{quota ? quota : 'max'} #{@period}")
+            end
+          end
+        end
+      end
+
+    end
+  end
+end
@@ -0,0 +1,141 @@
+require 'fileutils'
+
+module Distem
+  module Algorithm
+    module Network
+
+      # An algorithm that sets up the per destination latencies and bandwidths with an eBPF classifier (see NetworkExtension::EDTClassifier) instead of tc filters. The destinations are looked up in a BPF hash map, the packets get their departure time (paced at the bandwidth of their destination) and are held by a fq qdisc on an ifb device, so that changing the latencies is a single update of the map, without touching the qdiscs. The other limitations are applied as with TBF
+      class EBPF < TBF
+        # Bpf filesystem the classifiers are pinned on
+        PATH_BPFFS = '/sys/fs/bpf'
+        # Directory of the pinned classifiers (one directory per interface)
+        PATH_BPF = File.join(PATH_BPFFS, 'distem')
+        # Parameters of the fq qdiscs (of the ifb devices, or of the interfaces of
+        # the vnodes without ifb devices). The flow_limit has to
+        # hold the packets of a flow during its delay, the horizon is the
+        # maximal latency
+        FQ_PARAMS = 'limit 1000000 flow_limit 100000 horizon 60s'
+
+        # Create a new EBPF object
+        def initialize()
+          super()
+          @classifier = nil
+          @entries = {}
+          @netns = nil
+        end
+
+        # Apply limitations on a specific virtual network interface. Once the classifier is attached, only the entries of the map that changed are updated
+        # ==== Attributes
+        # * +viface+ The VIface object
+        #
+        def apply(viface)
+          if viface.latency_filters || viface.bandwidth_filters
+            check_destinations(viface)
+            attach(viface) unless @classifier
+            update_entries(viface)
+          else
+            detach(viface) if @classifier
+            super(viface)
+          end
+        end
+
+        # Undo limitations effective on a specific virtual network interface
+        # ==== Attributes
+        # * +viface+ The VIface object
+        #
+        def undo(viface)
+          if @classifier
+            detach(viface)
+          else
+            super(viface)
+          end
+        end
+
+        # Mount the bpf filesystem if needed
+        def self.mount_bpffs
+          @@lock.synchronize {
+            mounted = File.readlines('/proc/mounts').any? { |line|
+              fields = line.split
+              fields[1] == PATH_BPFFS && fields[2] == 'bpf'
+            }
+            Lib::Shell.run("mount -t bpf bpf #{PATH_BPFFS}") unless mounted
+            FileUtils.mkdir_p(PATH_BPF)
+          }
+        end
+
+        protected
+
+        # Set up the ifb device and attach the classifier on the interface. Without ifb devices (see Node::Admin.ifb?), the classifier is attached on the egress of the interface of the vnode, which holds the packets with its fq qdisc
+        def attach(viface)
+          iface = Lib::NetTools::get_iface_name(viface)
+          batch = TCWrapper::Batch.new
+          clean(viface, batch)
+          if Node::Admin.ifb?
+            allocate_ifb(viface)
+            fqiface, fqbatch = viface.ifb, batch
+            hook, hookbatch = 'ingress', batch
+          else
+            fqiface, fqbatch = output_iface(viface, batch)
+            iface, hook, hookbatch = fqiface, 'egress', fqbatch
+            @netns = fqbatch.pid
+          end
+
+          self.class.mount_bpffs
+          @classifier = NetworkExtension::EDTClassifier.new(File.join(PATH_BPF, Lib::NetTools::get_iface_name(viface)), viface.ifb)
+          @entries = {}
+          fqbatch.add("tc qdisc add dev #{fqiface} root fq #{FQ_PARAMS}")
+          hookbatch.add(TCWrapper::QdiscClsact.new(iface).get_cmd(TCWrapper::Action::ADD))
+          hookbatch.add("tc filter add dev #{iface} #{hook} prio 1 bpf object-pinned #{@classifier.prog_path} direct-action")
+          begin
+            batch.commit
+          rescue Lib::ShellError
+            @classifier.close
+            @classifier = nil
+            raise
+          end
+        end
+
+        # Remove the classifier and the fq qdisc
+        def detach(viface)
+          batch = TCWrapper::Batch.new
+          #the clsact qdisc of the vnode is not looked up by clean
+          if @netns && (LXCWrapper::Command.pid(viface.vnode.name) == @netns)
+            clsact = TCWrapper::QdiscClsact.new(viface.name)
+            batch.netns(@netns).add(clsact.get_cmd(TCWrapper::Action::DEL))
+          end
+          @netns = nil
+          clean(viface, batch)
+          batch.commit
+          @classifier.close
+          @classifier = nil
+          @entries = {}
+        end
+
+        # The keys of the map are host addresses, the destinations that are networks are refused before anything is set up
+        def check_destinations(viface)
+          _, networks = split_filters(viface)
+          raise Lib::InvalidParameterError, "#{networks.keys.join(', ')} (only host addresses with the #{BPF} algorithm)" unless networks.empty?
+        end
+
+        # Write the entries of the map that changed since the last update
+        def update_entries(viface)
+          latencies = viface.latency_filters || {}
+          bandwidths = viface.bandwidth_filters || {}
+          entries = {}
+          (latencies.keys | bandwidths.keys).each { |dest|
+            rate = Resource::Bandwidth.to_tc_bytes(bandwidths[dest] && bandwidths[dest].to_s)
+            entries[dest.to_s] = [(latencies[dest].to_f * 1000000).round, rate || 0]
+          }
+          (@entries.keys - entries.keys).each { |dest|
+            @classifier.delete(dest)
+          }
+          entries.each_pair { |dest,entry|
+            @classifier.update(dest, *entry) if @entries[dest] != entry
+          }
+          @entries = entries
+        end
+      end
+
+    end
+  end
+end
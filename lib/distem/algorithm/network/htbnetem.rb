@@ -0,0 +1,100 @@
+
+module Distem
+  module Algorithm
+    module Network
+
+      # An algorithm for high rates: the bandwidth is limited by a HTB class instead of netem (the rate of which loses accuracy and uses a lot of CPU above a few Gbit/s), the other limitations (delay, loss, ...) are applied by a netem leaf, or a fq_codel leaf if there is none. The qdiscs are replaced in place, so that the traffic is not interrupted when the limitations change. The per destination latencies and bandwidths are set up as with TBF
+      class HTBNetem < TBF
+        # Quantum of the HTB class (there is a single class, the default one
+        # computed from the rate is too big at high rates)
+        QUANTUM = 1514
+        # Duration of the burst of the HTB class in seconds (the default burst,
+        # computed from the timer frequency, is rounded to 0 at high rates)
+        BURST_TIME = 0.001
+        # Minimal burst of the HTB class in bytes
+        BURST_MIN = 15140
+        # Minimal size in packets of the queue of the netem leaf, it is large
+        # enough to hold the packets sent at rate during the delay otherwise
+        NETEM_LIMIT = 1000
+        # Size of the packets the netem queue is computed with
+        NETEM_PACKET = 1500
+
+        # Create a new HTBNetem object
+        def initialize()
+          super()
+          @htb = []
+        end
+
+        # Clean every previous run config
+        # ==== Attributes
+        # * +batch+ The TCWrapper::Batch the commands are added to (run immediately if nil)
+        #
+        def clean(viface, batch=nil)
+          @htb = []
+          super(viface, batch)
+        end
+
+        # Set up the limitations of a traffic direction: the bandwidth with a HTB class, the others with a netem leaf. Without bandwidth, the netem qdisc is at the root of the interface (as with TBF)
+        # ==== Attributes
+        # * +iface+ The name of the interface
+        # * +batch+ The TCWrapper::Batch the commands are added to
+        # * +action+ Unused, the qdiscs are always replaced
+        # * +params+ The limitations (Hash, property name => property)
+        #
+        def shape(iface, batch, action, params)
+          netem = netem(TCWrapper::Action::REPLACE, iface, params)
+          bandwidth = netem.bandwidth
+          if bandwidth.nil?
+            batch.add(netem.get_cmd())
+            @htb.delete(iface)
+            return
+          end
+
+          rate = bandwidth[:rate]
+          #htb does not support to be changed
+          unless @htb.include?(iface)
+            batch.add("tc qdisc replace dev #{iface} root handle 1: htb default 1")
+            @htb << iface
+          end
+          burst = burst(rate)
+          batch.add("tc class replace dev #{iface} parent 1: classid 1:1 htb rate #{rate} ceil #{rate} quantum #{QUANTUM}" \
+            "#{burst ? " burst #{burst} cburst #{burst}" : ''}")
+          netem.bandwidth = nil
+          if netem.empty?
+            batch.add("tc qdisc replace dev #{iface} parent 1:1 fq_codel")
+          else
+            netem.parent = '1:1'
+            netem.limit = netem_limit(rate, netem.latency)
+            batch.add(netem.get_cmd())
+          end
+        end
+
+
+        # The burst of the HTB class for a rate (nil if the rate cannot be parsed, the default burst is then used)
+        def burst(rate)
+          begin
+            bytes = Resource::Bandwidth.to_tc_bytes(rate)
+          rescue ArgumentError
+            return nil
+          end
+          return nil unless bytes
+          return [BURST_MIN, (bytes * BURST_TIME).ceil].max
+        end
+
+
+        # The queue size of the netem leaf for a rate and a latency
+        def netem_limit(rate, latency)
+          begin
+            delay = Resource::Latency.to_secs(latency && latency[:delay])
+            bytes = Resource::Bandwidth.to_tc_bytes(rate)
+          rescue ArgumentError
+            return NETEM_LIMIT
+          end
+          return NETEM_LIMIT unless delay && bytes
+          return [NETEM_LIMIT, (2 * bytes * delay / NETEM_PACKET).ceil].max
+        end
+      end
+
+    end
+  end
+end
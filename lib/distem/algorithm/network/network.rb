@@ -0,0 +1,10 @@
+module Distem
+  module Algorithm
+    # A module that includes algorithms to apply network limitations on a physical resource
+    module Network
+      TC="tc"
+      BPF="ebpf"
+      HTB="htb"
+    end
+  end
+end
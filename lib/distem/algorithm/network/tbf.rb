@@ -5,144 +5,253 @@ module Distem
 
       # An algorithm that's using TC Token Bucket Filter (see http://en.wikipedia.org/wiki/Token_bucket) to limit network traffic
       class TBF < TCAlgorithm
+        # Handle of the first u32 hash table of the latency filters (the next ones follow, up to 256 of them)
+        HASH_TABLE_BASE = 0x100
+        # First node id of the filters in a bucket of a hash table
+        HASH_NODE_BASE = 0x800
+
         # Create a new TBF object
         def initialize()
           super()
+          @filters = nil
         end
 
-        # Apply limitations on a specific virtual network interface
+        # Apply limitations on a specific virtual network interface. The tc commands (including the cleaning of the previous configuration) are run at once in a single batch. If the per destination latencies and bandwidths were already set up, only their differences are applied
         # ==== Attributes
         # * +viface+ The VIface object
         #
         def apply(viface)
-          super(viface)
-          if viface.latency_filters
-            apply_filters(viface)
+          batch = TCWrapper::Batch.new
+          filters = viface.latency_filters || viface.bandwidth_filters
+          if filters && @filters && update_filters(viface, batch)
+            batch.commit
+            return
+          end
+
+          @filters = nil
+          super(viface, batch)
+          if filters
+            apply_filters(viface, batch)
           else
             if viface.voutput
-              apply_vtraffic(viface.voutput)
+              apply_vtraffic(viface.voutput, batch)
             end
             if viface.vinput
-              apply_vtraffic(viface.vinput)
+              apply_vtraffic(viface.vinput, batch)
             end
           end
+          batch.commit
         end
 
 
-        def apply_filters(viface)
-          baseiface = Lib::NetTools::get_iface_name(viface)
-          latency_mapping = viface.latency_filters.values.uniq
-          nb_filters = latency_mapping.length
-          if nb_filters > 255
-            raise "Too many different latency values for #{viface.vnode.name}"
-          end
-
-          ingressroot = TCWrapper::QdiscIngress.new(baseiface)
-          add = ingressroot.get_cmd(TCWrapper::Action::ADD)
-          Lib::Shell.run(add)
-          viface.ifb = @@ifballocator.get_ifb if viface.ifb.nil?
-          iface = viface.ifb
+        # Set up the per destination latencies and bandwidths of a virtual network interface, on the interface its output traffic is shaped on (see TCAlgorithm#output_iface). The destination address is looked up with u32 hash tables, so that the classification of a packet does not depend on the number of destinations: a first table is hashed on the third byte of the address, then a second table on its fourth byte. Every latency value has its own DRR class with a netem leaf, shared by the destinations without bandwidth. A destination with a bandwidth has its own class, the netem leaf of which also limits the rate. The destinations that are networks (not /32 addresses) are matched afterwards by a linear chain of filters
+        # ==== Attributes
+        # * +viface+ The VIface object
+        # * +batch+ The TCWrapper::Batch the commands are added to
+        #
+        def apply_filters(viface, batch)
+          iface, batch = output_iface(viface, batch)
           qdiscroot = TCWrapper::QdiscRoot.new(iface)
 
-          prio = TCWrapper::QdiscPrio.new(iface, qdiscroot, { 'bands' => 16 })
-          add = prio.get_cmd(TCWrapper::Action::ADD)
-          Lib::Shell.run(add)
-          prio_roots = []
-          netem = []
-          if (nb_filters < 16)
-            #1 prio level
-            prio_roots << prio
-            #create the Netem queues
-            latency_mapping.each { |lat|
-              current = TCWrapper::QdiscNetem.new(iface, prio, { 'delay' => "#{lat}ms"})
-              netem << current
-              add = current.get_cmd(TCWrapper::Action::ADD)
-              Lib::Shell.run(add)
-            }
-            viface.latency_filters.each_pair { |dest,val|
-              filter = TCWrapper::FilterU32.new(iface, prio, netem[latency_mapping.index(val)], "ip", 1)
-              filter.add_match_ip_dst(dest)
-              add = filter.get_cmd(TCWrapper::Action::ADD)
-              Lib::Shell.run(add)
-            }
-            #default traffic
-            fake_qdisc = TCWrapper::QdiscPrio.new(iface, prio)
-            filter = TCWrapper::FilterU32.new(iface, prio, fake_qdisc, "ip", 2)
-            filter.add_match_u32('0','0')
-            cmd = filter.get_cmd(TCWrapper::Action::ADD)
-            Lib::Shell.run(cmd)
-          else
-            #2 prio levels
-            nb_2nd_level_prios = ((nb_filters + 1) / 16) + (((nb_filters + 1) % 16) > 0 ? 1 : 0)
-            (0...nb_2nd_level_prios).each {
-              current = TCWrapper::QdiscPrio.new(iface, prio, { 'bands' => 16})
-              prio_roots << current
-              add = current.get_cmd(TCWrapper::Action::ADD)
-              Lib::Shell.run(add)
-            }
-            #create the Netem queues
-            latency_mapping.each { |lat|
-              current = TCWrapper::QdiscNetem.new(iface, prio_roots[latency_mapping.index(lat) / 16], { 'delay' => "#{lat}ms"})
-              netem << current
-              add = current.get_cmd(TCWrapper::Action::ADD)
-              Lib::Shell.run(add)
-            }
-            #Filters
-            viface.latency_filters.each_pair { |dest,val|
-              filter = TCWrapper::FilterU32.new(iface, prio, prio_roots[latency_mapping.index(val) / 16], "ip", 1)
-              filter.add_match_ip_dst(dest)
-              add = filter.get_cmd(TCWrapper::Action::ADD)
-              Lib::Shell.run(add)
-              filter = TCWrapper::FilterU32.new(iface, prio_roots[latency_mapping.index(val) / 16], netem[latency_mapping.index(val)], "ip", 1)
-              filter.add_match_ip_dst(dest)
-              add = filter.get_cmd(TCWrapper::Action::ADD)
-              Lib::Shell.run(add)
-            }
+          drr = TCWrapper::QdiscDRR.new(iface, qdiscroot)
+          batch.add(drr.get_cmd(TCWrapper::Action::ADD))
+          #DRR drops the packets that are not classified
+          default = TCWrapper::ClassDRR.new(iface, drr)
+          batch.add(default.get_cmd(TCWrapper::Action::ADD))
 
-            #default traffic
-            fake_qdisc = TCWrapper::QdiscPrio.new(iface, prio_roots[nb_filters / 16])
-            filter = TCWrapper::FilterU32.new(iface, prio_roots[nb_filters / 16], fake_qdisc, "ip", 2)
-            filter.add_match_u32('0','0')
-            cmd = filter.get_cmd(TCWrapper::Action::ADD)
-            Lib::Shell.run(cmd)
-          end
-          filter = TCWrapper::FilterU32.new(baseiface, ingressroot, qdiscroot)
+          roottable = HASH_TABLE_BASE.to_s(16) + ":"
+          filter = TCWrapper::FilterU32.new(iface, drr, nil, "ip", 1)
+          filter.set_hash_table(roottable, 256)
+          batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+          filter = TCWrapper::FilterU32.new(iface, drr, nil, "ip", 1)
+          filter.set_ht("800::")
+          filter.add_match_ip_dst("0.0.0.0/0")
+          filter.set_hash_link(roottable, "0x0000ff00", 16)
+          batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+
+          networks = split_filters(viface)[1]
+          @filters = {
+            :iface => iface,
+            :drr => drr,
+            :roottable => roottable,
+            :classes => {},   # class key (see split_filters) => ClassDRR
+            :free => [],      # deleted ClassDRR, to reuse their ids
+            :tables => {},    # third byte => hash table
+            :hosts => {},     # address => [filter handle, class id]
+            :nodes => {},     # bucket => node ids in use
+            :networks => networks,
+            :netns => batch.pid,
+          }
+          update_filters(viface, batch)
+
+          networks.each_pair { |dest,key|
+            filter = TCWrapper::FilterU32.new(iface, drr, @filters[:classes][key], "ip", 2)
+            filter.add_match_ip_dst(dest)
+            batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+          }
+
+          #default traffic
+          filter = TCWrapper::FilterU32.new(iface, drr, default, "all", 3)
           filter.add_match_u32('0','0')
-          filter.add_param("action","mirred egress")
-          filter.add_param("redirect","dev #{iface}")
-          Lib::Shell.run(filter.get_cmd(TCWrapper::Action::ADD))
+          batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+        end
+
+
+        # Apply the differences between the latencies and bandwidths that are set up and the ones of a virtual network interface: the netem leaves of the classes that are no longer used are changed to the new values, the filters of the destinations are added, changed or deleted. The other tc objects are left untouched, so that the traffic is not interrupted
+        # ==== Attributes
+        # * +viface+ The VIface object
+        # * +batch+ The TCWrapper::Batch the commands are added to
+        # ==== Returns
+        # false if the differences cannot be applied (the destinations that are networks changed), the latencies have to be set up again
+        #
+        def update_filters(viface, batch)
+          hosts, networks = split_filters(viface)
+          return false if networks != @filters[:networks]
+          batch = batch.netns(@filters[:netns])
+
+          iface = @filters[:iface]
+          classes = @filters[:classes]
+          keys = (hosts.values + networks.values).uniq
+          stale = classes.keys - keys
+          (keys - classes.keys).each { |key|
+            #netem keeps its rate if it is not given, only a class with a
+            #bandwidth is changed to another one with a bandwidth
+            old = stale.find { |k| k[1].nil? == key[1].nil? }
+            if old.nil?
+              cls = @filters[:free].shift || TCWrapper::ClassDRR.new(iface, @filters[:drr])
+              batch.add(cls.get_cmd(TCWrapper::Action::ADD))
+              #no handle, the majors of TCWrapper::Id would overflow with
+              #thousands of leaves
+              batch.add("tc qdisc add dev #{iface} parent #{cls.id} #{netem_params(key)}")
+            else
+              cls = classes.delete(stale.delete(old))
+              batch.add("tc qdisc change dev #{iface} parent #{cls.id} #{netem_params(key)}")
+            end
+            classes[key] = cls
+          }
+
+          current = @filters[:hosts]
+          (current.keys - hosts.keys).each { |addr|
+            handle = current.delete(addr)[0]
+            bucket = handle.sub(/[^:]*\z/, '')
+            @filters[:nodes][bucket].delete(handle.split(':').last.to_i(16))
+            filter = TCWrapper::FilterU32.new(iface, @filters[:drr], nil, "ip", 1)
+            filter.handle = handle
+            batch.add(filter.get_cmd(TCWrapper::Action::DEL))
+          }
+          hosts.each_pair { |addr,key|
+            cls = classes[key]
+            entry = current[addr]
+            next if entry && (entry[1] == cls.id.to_s)
+
+            if entry
+              action = TCWrapper::Action::CHANGE
+              handle = entry[0]
+              bucket = handle.sub(/[^:]*\z/, '')
+            else
+              action = TCWrapper::Action::ADD
+              octets = addr.split('.').collect { |byte| byte.to_i }
+              bucket = "#{hash_table(octets[2], batch)}#{octets[3].to_s(16)}:"
+              nodes = (@filters[:nodes][bucket] ||= [])
+              node = HASH_NODE_BASE
+              node += 1 while nodes.include?(node)
+              nodes << node
+              handle = "#{bucket}#{node.to_s(16)}"
+            end
+            filter = TCWrapper::FilterU32.new(iface, @filters[:drr], cls, "ip", 1)
+            filter.handle = handle
+            filter.set_ht(bucket)
+            filter.add_match_ip_dst(addr)
+            batch.add(filter.get_cmd(action))
+            current[addr] = [handle, cls.id.to_s]
+          }
+
+          stale.each { |key|
+            cls = classes.delete(key)
+            batch.add("tc class del dev #{iface} classid #{cls.id}")
+            @filters[:free] << cls
+          }
+
+          return true
+        end
+
+
+        # Split the destinations of the latencies and bandwidths of a virtual network interface in two Hashes: the /32 addresses and the networks. Their values are the keys of the classes the destinations are classified in, [latency, rate, destination]: the destinations without bandwidth share the class [latency, nil, nil]
+        def split_filters(viface)
+          latencies = viface.latency_filters || {}
+          bandwidths = viface.bandwidth_filters || {}
+          hosts = {}
+          networks = {}
+          (latencies.keys | bandwidths.keys).each { |dest|
+            rate = bandwidths[dest]
+            key = [latencies[dest] || 0, rate, (rate ? dest.to_s : nil)]
+            addr = IPAddress.parse(dest.to_s) rescue nil
+            if addr && addr.ipv4? && (addr.prefix.to_i == 32)
+              hosts[addr.to_s] = key
+            else
+              networks[dest] = key
+            end
+          }
+          return hosts, networks
+        end
+
+
+        # The parameters of the netem leaf of a class
+        def netem_params(key)
+          lat, rate = key
+          return "netem delay #{lat}ms#{rate ? " rate #{rate}" : ''}"
+        end
+
+
+        # The hash table of the addresses with this third byte, created if needed
+        def hash_table(byte, batch)
+          table = @filters[:tables][byte]
+          return table if table
+
+          iface = @filters[:iface]
+          table = (HASH_TABLE_BASE + 1 + @filters[:tables].size).to_s(16) + ":"
+          @filters[:tables][byte] = table
+          filter = TCWrapper::FilterU32.new(iface, @filters[:drr], nil, "ip", 1)
+          filter.set_hash_table(table, 256)
+          batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+          filter = TCWrapper::FilterU32.new(iface, @filters[:drr], nil, "ip", 1)
+          filter.set_ht("#{@filters[:roottable]}#{byte.to_s(16)}:")
+          filter.add_match_u32('0','0')
+          filter.set_hash_link(table, "0x000000ff", 16)
+          batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+          return table
         end
 
 
         # Apply the limitation following a specific traffic instruction
         # ==== Attributes
         # * +vtraffic+ The VTraffic object
+        # * +batch+ The TCWrapper::Batch the commands are added to (run immediately if nil)
         #
-        def apply_vtraffic(vtraffic)
+        def apply_vtraffic(vtraffic, batch=nil)
+          run = batch.nil?
+          batch = TCWrapper::Batch.new if run
 
           limited_netem_output = @limited_netem_output
           limited_netem_input = @limited_netem_input
 
-          @limited_netem_output = false
-          @limited_netem_input = false
-
           iface = Lib::NetTools::get_iface_name(vtraffic.viface)
-          baseiface = iface
+          ifacebatch = batch
           action = nil
           direction = nil
           case vtraffic.direction
           when Resource::VIface::VTraffic::Direction::INPUT
             direction = 'input'
           when Resource::VIface::VTraffic::Direction::OUTPUT
-            if !(limited_netem_output) && vtraffic.limited?
-              Lib::Shell.run("tc qdisc add dev #{iface} ingress")
-              vtraffic.viface.ifb = @@ifballocator.get_ifb if vtraffic.viface.ifb.nil?
-              iface = vtraffic.viface.ifb
+            if vtraffic.limited?
+              iface, ifacebatch = output_iface(vtraffic.viface, batch, !limited_netem_output)
             end
             direction = 'output'
           else
             raise "Invalid direction"
           end
+          #the other direction is left as is
+          self.instance_variable_set("@limited_netem_#{direction}", false)
 
           if vtraffic.limited?
             existing_netem_params = nil
@@ -167,48 +276,63 @@ module Distem
             @@lock.synchronize {
               @@store[vtraffic.viface]["netem_#{direction}"] = netem_params
             }
-            netem = TCWrapper::Netem.new(action, iface)
+            shape(iface, ifacebatch, action, netem_params)
+          end
 
-            bandwidth = netem_params[Resource::Bandwidth.name]
-            if bandwidth && bandwidth.rate
-              netem.bandwidth = {:rate => bandwidth.rate}
-            end
+          batch.commit if run
+        end
 
-            latency = netem_params[Resource::Latency.name]
-            if latency && latency.delay
-              netem.latency = {:delay => latency.delay}
-              if latency.jitter
-                netem.latency[:jitter] = latency.jitter
-              end
-            end
 
-            loss = netem_params[Resource::Loss.name]
-            if loss && loss.percent
-              netem.loss = {:percent => loss.percent}
-            end
+        # Set up the limitations of a traffic direction, with a netem qdisc at the root of the interface
+        # ==== Attributes
+        # * +iface+ The name of the interface
+        # * +batch+ The TCWrapper::Batch the commands are added to
+        # * +action+ :add or :change
+        # * +params+ The limitations (Hash, property name => property)
+        #
+        def shape(iface, batch, action, params)
+          batch.add(netem(action, iface, params).get_cmd())
+        end
 
-            corruption = netem_params[Resource::Corruption.name]
-            if corruption && corruption.percent
-              netem.corruption = {:percent => corruption.percent}
-            end
 
-            duplication = netem_params[Resource::Duplication.name]
-            if duplication && duplication.percent
-              netem.duplication = {:percent => duplication.percent}
-            end
+        # The TCWrapper::Netem of limitations
+        def netem(action, iface, params)
+          netem = TCWrapper::Netem.new(action, iface)
 
-            reordering = netem_params[Resource::Reordering.name]
-            if reordering && reordering.percent
-              netem.reordering = {:percent => reordering.percent}
+          bandwidth = params[Resource::Bandwidth.name]
+          if bandwidth && bandwidth.rate
+            netem.bandwidth = {:rate => bandwidth.rate}
+          end
+
+          latency = params[Resource::Latency.name]
+          if latency && latency.delay
+            netem.latency = {:delay => latency.delay}
+            if latency.jitter
+              netem.latency[:jitter] = latency.jitter
             end
+          end
+
+          loss = params[Resource::Loss.name]
+          if loss && loss.percent
+            netem.loss = {:percent => loss.percent}
+          end
 
-            Lib::Shell.run(netem.get_cmd())
+          corruption = params[Resource::Corruption.name]
+          if corruption && corruption.percent
+            netem.corruption = {:percent => corruption.percent}
           end
 
-          if (vtraffic.direction == Resource::VIface::VTraffic::Direction::OUTPUT) &&
-             (vtraffic.limited?)
-            Lib::Shell.run("tc filter add dev #{baseiface} parent ffff: protocol ip u32 match u32 0 0 flowid 1:0x1 action mirred egress redirect dev #{iface}")
+          duplication = params[Resource::Duplication.name]
+          if duplication && duplication.percent
+            netem.duplication = {:percent => duplication.percent}
           end
+
+          reordering = params[Resource::Reordering.name]
+          if reordering && reordering.percent
+            netem.reordering = {:percent => reordering.percent}
+          end
+
+          return netem
         end
 
 
@@ -218,25 +342,8 @@ module Distem
         #
         def undo(viface)
           super(viface)
-          @@lock.synchronize {
-            @@store[viface] = {}
-          }
-
-          iface = Lib::NetTools::get_iface_name(viface)
-
-          if (@limited_netem_output)
-            outputroot = TCWrapper::QdiscRoot.new(viface.ifb)
-            Lib::Shell.run(outputroot.get_cmd(TCWrapper::Action::DEL))
-            outputroot = TCWrapper::QdiscIngress.new(iface)
-            Lib::Shell.run(outputroot.get_cmd(TCWrapper::Action::DEL))
-            @limited_netem_output = false
-          end
-
-          if (@limited_netem_input)
-            inputroot = TCWrapper::QdiscRoot.new(iface)
-            Lib::Shell.run(inputroot.get_cmd(TCWrapper::Action::DEL))
-            @limited_netem_intput = false
-          end
+          clean(viface)
+          @filters = nil
         end
       end
     end
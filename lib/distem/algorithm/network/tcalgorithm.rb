@@ -13,13 +13,18 @@ module Distem
         def initialize()
           @limited_netem_output = false
           @limited_netem_input = false
+          @netns_output = nil
+          @released_ifb = nil
           if @@ifballocator.nil?
             @@ifballocator = Node::IFBAllocator::new
           end
         end
 
         # :nodoc:
-        def apply(viface)
+        # ==== Attributes
+        # * +batch+ The TCWrapper::Batch the cleaning commands are added to (run immediately if nil)
+        #
+        def apply(viface, batch=nil)
           @@lock.synchronize {
             @@store[viface] = {} if !@@store[viface]
           }
@@ -27,13 +32,16 @@ module Distem
           netem_output = (viface.voutput != nil) && viface.voutput.limited?
           netem_input = (viface.vinput != nil) && viface.vinput.limited?
 
-          clean(viface) if (netem_input != @limited_netem_input) ||
+          clean(viface, batch) if (netem_input != @limited_netem_input) ||
             (netem_output != @limited_netem_output) ||
-            viface.latency_filters
+            viface.latency_filters || viface.bandwidth_filters
         end
 
         # Clean every previous run config
-        def clean(viface)
+        # ==== Attributes
+        # * +batch+ The TCWrapper::Batch the commands are added to (run immediately if nil)
+        #
+        def clean(viface, batch=nil)
           @limited_netem_output = false
           @limited_netem_input = false
           @@lock.synchronize {
@@ -42,25 +50,90 @@ module Distem
 
           iface = Lib::NetTools::get_iface_name(viface)
           ifb = viface.ifb
+          run = batch.nil?
+          batch = TCWrapper::Batch.new if run
 
-          str = Lib::Shell.run("tc qdisc show || true").split(/\n/).grep(/ dev #{ifb} /)
-          if not str.empty? and (not str[0].include?('pfifo_fast') and not str[0].include?('noqueue'))
+          defaults = ['pfifo_fast', 'noqueue']
+
+          qdiscs = (ifb ? Lib::NetTools.get_qdiscs(ifb) : [])
+          if not qdiscs.empty? and not defaults.include?(qdiscs[0]['kind'])
             inputroot = TCWrapper::QdiscRoot.new(ifb)
-            Lib::Shell.run(inputroot.get_cmd(TCWrapper::Action::DEL))
+            batch.add(inputroot.get_cmd(TCWrapper::Action::DEL))
           end
 
-          str = Lib::Shell.run("tc qdisc show | grep \" #{iface} \"| grep ingress || true")
-          if str and !str.empty?
+          qdiscs = Lib::NetTools.get_qdiscs(iface)
+          if qdiscs.any? { |qdisc| qdisc['kind'] == 'ingress' }
             inputroot = TCWrapper::QdiscIngress.new(iface)
-            Lib::Shell.run(inputroot.get_cmd(TCWrapper::Action::DEL))
+            batch.add(inputroot.get_cmd(TCWrapper::Action::DEL))
+          end
+          if qdiscs.any? { |qdisc| qdisc['kind'] == 'clsact' }
+            inputroot = TCWrapper::QdiscClsact.new(iface)
+            batch.add(inputroot.get_cmd(TCWrapper::Action::DEL))
+          end
+
+          if ifb
+            #the ifb is given to another vnode only once its root qdisc is
+            #deleted, it is kept if the same batch sets it up again
+            @released_ifb = ifb
+            batch.after_commit {
+              @released_ifb = nil if @released_ifb == ifb
+              @@ifballocator.free_ifb(ifb) unless viface.ifb == ifb
+            }
+            viface.ifb = nil
           end
 
-          @@ifballocator.free_ifb(ifb)
+          #the network namespace is a new one if the container was restarted
+          if @netns_output
+            if LXCWrapper::Command.pid(viface.vnode.name) == @netns_output
+              outputroot = TCWrapper::QdiscRoot.new(viface.name)
+              batch.netns(@netns_output).add(outputroot.get_cmd(TCWrapper::Action::DEL))
+            end
+            @netns_output = nil
+          end
 
-          str = Lib::Shell.run("tc qdisc show | grep \" #{iface} \"")
-          if str and not str.empty? and ( not str.include?('pfifo_fast') and not str.include?('noqueue'))
+          qdiscs = qdiscs.reject { |qdisc| ['ingress', 'clsact'].include?(qdisc['kind']) }
+          if not qdiscs.empty? and qdiscs.none? { |qdisc| defaults.include?(qdisc['kind']) }
             outputroot = TCWrapper::QdiscRoot.new(iface)
-            Lib::Shell.run(outputroot.get_cmd(TCWrapper::Action::DEL))
+            batch.add(outputroot.get_cmd(TCWrapper::Action::DEL))
+          end
+
+          batch.commit if run
+        end
+
+        # Give an ifb device to a virtual network interface (if it has none), the one released by the cleaning of the batch being built is taken back
+        def allocate_ifb(viface)
+          viface.ifb = (@released_ifb || @@ifballocator.get_ifb) if viface.ifb.nil?
+          @released_ifb = nil
+          return viface.ifb
+        end
+
+        # Get the interface the output traffic of a virtual network interface is shaped on. This traffic is received on the ingress of the interface of the vnode on the pnode, it is redirected to an ifb device. Without ifb devices (see Node::Admin.ifb?), it is shaped on the egress of the interface of the vnode itself, in the network namespace of its container: this shaping is not isolated from the vnode, root in the vnode can see it and remove it
+        # ==== Attributes
+        # * +viface+ The VIface object
+        # * +batch+ The TCWrapper::Batch the commands are added to
+        # * +setup+ Set up the redirection to the ifb device (if it was not already)
+        # ==== Returns
+        # [String, TCWrapper::Batch] the name of the interface and the batch its commands are added to
+        #
+        def output_iface(viface, batch, setup=true)
+          if Node::Admin.ifb?
+            if setup
+              baseiface = Lib::NetTools::get_iface_name(viface)
+              ingressroot = TCWrapper::QdiscIngress.new(baseiface)
+              batch.add(ingressroot.get_cmd(TCWrapper::Action::ADD))
+              allocate_ifb(viface)
+              filter = TCWrapper::FilterU32.new(baseiface, ingressroot, TCWrapper::QdiscRoot.new(viface.ifb))
+              filter.add_match_u32('0','0')
+              filter.add_param("action","mirred egress")
+              filter.add_param("redirect","dev #{viface.ifb}")
+              batch.add(filter.get_cmd(TCWrapper::Action::ADD))
+            end
+            return viface.ifb, batch
+          else
+            pid = LXCWrapper::Command.pid(viface.vnode.name)
+            raise Lib::UninitializedResourceError, viface.vnode.name unless pid
+            @netns_output = pid
+            return viface.name, batch.netns(pid)
           end
         end
       end
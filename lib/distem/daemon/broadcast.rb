@@ -0,0 +1,59 @@
+require 'thread'
+
+module Distem
+  module Daemon
+
+    # Broadcast of a call to the physical nodes along a k-ary tree: the targets are split in ARITY subtrees, the call is sent to the root of each subtree which runs it, relays it to the subtrees of its descendants (see DistemPnode#broadcast) and returns the results of its whole subtree. The sender then only sends ARITY requests whatever the number of targets
+    module Broadcast
+      # The number of children of a node of the tree
+      ARITY = 8
+      # The port of the pnode daemons
+      PORT = 4568
+
+      # Send a call to the targets and gather the results
+      # ==== Attributes
+      # * +method+ The name of the method of DistemPnode to call (see DistemPnode::BROADCAST_METHODS)
+      # * +args+ The arguments of the call (Array)
+      # * +targets+ Hash, address => the arguments of the call for this target (nil for +args+)
+      # * +digest+ The digest of the content sent, a target that already got it skips the call (nil to never skip)
+      # * +arity+ The arity of the tree
+      # ==== Returns
+      # Hash, target => {'status' => 'ok', 'result' => value}, {'status' => 'skipped'} or {'status' => 'error', 'error' => message}
+      #
+      def self.call(method, args, targets, digest=nil, arity=ARITY)
+        results = {}
+        lock = Mutex.new
+        threads = split(targets.to_a, arity).collect { |root,subtree|
+          Thread.new {
+            begin
+              cl = NetAPI::Client.new(root[0], PORT)
+              ret = cl.broadcast(method, args, root[0], Hash[[root] + subtree], digest, arity)
+            rescue Exception => e
+              # the subtree is sent again without its root
+              ret = { root[0] => { 'status' => 'error', 'error' => e.to_s } }
+              ret.merge!(call(method, args, Hash[subtree], digest, arity)) unless subtree.empty?
+            end
+            lock.synchronize { results.merge!(ret) }
+          }
+        }
+        threads.each { |thread| thread.join }
+        return results
+      end
+
+      # The errors of the results of call (Hash, target => message)
+      def self.errors(results)
+        ret = {}
+        results.each_pair { |target,result| ret[target] = result['error'] if result['status'] == 'error' }
+        return ret
+      end
+
+      # Split the targets (Array of [target, args]) in at most arity subtrees of contiguous targets, returns an Array of [root, [descendants]]
+      def self.split(targets, arity=ARITY)
+        return [] if targets.empty?
+        size = (targets.size.to_f / [arity, 1].max).ceil
+        return targets.each_slice(size).collect { |slice| [slice.first, slice[1..-1]] }
+      end
+    end
+
+  end
+end
@@ -4,8 +4,7 @@ require 'ipaddress'
 require 'json'
 require 'pp'
 require 'resolv'
-require 'zlib'
-require 'base64'
+require 'digest/sha1'
 require 'cgi'
 
 module Distem
@@ -62,7 +61,7 @@ module Distem
       # This step have to be performed to be able to create virtual nodes on a machine
       # ==== Attributes
       # * +target+ the name/address of the physical machine
-      # * +properties+ async,max_vifaces,cpu_algorithm
+      # * +properties+ async,max_vifaces,cpu_algorithm,network_algorithm
       # ==== Returns
       # Resource::PNode object
       # ==== Exceptions
@@ -132,14 +131,26 @@ module Distem
         pnode = pnode_get(target)
 
         if desc['algorithms']
+          ret = {'algorithms' => {}}
           if desc['algorithms']['cpu']
             algo = desc['algorithms']['cpu'].upcase
             raise InvalidParameterError "algorithms/cpu" unless \
             [Algorithm::CPU::GOV.upcase,
-             Algorithm::CPU::HOGS.upcase].include?(algo)
+             Algorithm::CPU::HOGS.upcase,
+             Algorithm::CPU::QUOTA.upcase].include?(algo)
             pnode.algorithms[:cpu] = algo
-            return {'algorithms' => {'cpu'=> algo }}
+            ret['algorithms']['cpu'] = algo
           end
+          if desc['algorithms']['network']
+            algo = desc['algorithms']['network'].upcase
+            raise Lib::InvalidParameterError, "algorithms/network" unless \
+            [Algorithm::Network::TC.upcase,
+             Algorithm::Network::BPF.upcase,
+             Algorithm::Network::HTB.upcase].include?(algo)
+            pnode.algorithms[:network] = algo
+            ret['algorithms']['network'] = algo
+          end
+          return ret
         end
       end
 
@@ -585,12 +596,12 @@ module Distem
             end
             if vnodes_to_create
               descs = []
-              # Create VNetworks on remote PNode
-              # TODO: vectorize vnetwork_sync
+              # Create the VNetworks of the whole batch on the remote PNode
+              unless vnodes_to_create.empty?
+                vnets = vnodes_to_create.collect { |vnode| vnode.get_vnetworks }.flatten.uniq
+                vnetworks_sync(vnets, vnodes_to_create.first.host)
+              end
               vnodes_to_create.each { |vnode|
-                vnode.get_vnetworks.each do |vnet|
-                  vnetwork_sync(vnet,vnode.host)
-                end
                 desc = TopologyStore::HashWriter.new.visit(vnode)
                 desc['status'] = Resource::Status::RUNNING
                 descs << desc
@@ -1269,35 +1280,83 @@ module Distem
         return ret
       end
 
-      def vnetwork_sync(vnet, pnode, lock=true)
-        block = Proc.new do
-          if !vnet.visibility.include?(pnode)
-            vnet.visibility << pnode
-            cl = NetAPI::Client.new(pnode.address.to_s, 4568)
-            # Adding VNetwork on the pnode
-            opts = vnet.opts
-            opts['nb_pnodes'] = @daemon_resources.pnodes.length
-            opts['pnode_index'] = @daemon_resources.pnodes.keys.index(pnode.address.to_s)
-            cl.vnetwork_create(vnet.name,vnet.address.to_string,opts)
-            # Adding VRoutes to the new VNetwork
-            vnet.vroutes.values.each do |vroute|
-              vnetwork_sync(vroute.dstnet,pnode,false)
-              cl.vroute_create(vnet.name,vroute.dstnet.name,vroute.gw.to_s)
+      # Execute a command on a set of vnodes, the output of every pnode is relayed as it comes
+      # ==== Attributes
+      # * +names+ The names of the vnodes
+      # * +command+ The command
+      # * +timeout+ The time (in seconds) after which the command is killed on a vnode, nil for no limit
+      # ==== Yields
+      # Every chunk of output (see DistemPnode#vnodes_execute_stream), the vnodes of a pnode that failed get their end with an 'error'
+      def vnodes_execute_stream(names, command, timeout = nil)
+        names = [names] if !names.is_a?(Array)
+        vnodesperpnode = Hash.new { |hash,address| hash[address] = [] }
+        names.each { |name|
+          vnode = vnode_get(name)
+          raise Lib::UninitializedResourceError, vnode.name unless vnode.host
+          vnodesperpnode[vnode.host.address.to_s] << vnode.name
+        }
+        lock = Mutex.new
+        w = Distem::Lib::Synchronization::SlidingWindow.new(WINDOW_SIZE)
+        vnodesperpnode.each { |address,n|
+          w.add(Proc.new {
+            ended = []
+            begin
+              Distem.client(address, 4568) do |cl|
+                cl.vnodes_execute_stream(n, command, timeout) { |chunk|
+                  ended << chunk['vnode'] if chunk['stream'] == 'exit'
+                  lock.synchronize { yield chunk }
+                }
+              end
+            rescue Lib::DistemError, StandardError => e
+              lock.synchronize {
+                (n - ended).each { |name| yield({ 'vnode' => name, 'stream' => 'exit', 'error' => e.to_s }) }
+              }
             end
-          end
-        end
+          })
+        }
+        w.run
+      end
 
-        if lock
-          @lockslock.synchronize {
-            @locks[:vnetsync][pnode] = Mutex.new unless \
-            @locks[:vnetsync][pnode]
-          }
+      def vnetwork_sync(vnet, pnode)
+        vnetworks_sync([vnet], pnode)
+      end
 
-          @locks[:vnetsync][pnode].synchronize do
-            block.call
+      # Create on a physical node, with a single request, the virtual networks
+      # that are not yet visible on it (and the ones their virtual routes lead
+      # to) along with their virtual routes
+      def vnetworks_sync(vnets, pnode)
+        @lockslock.synchronize {
+          @locks[:vnetsync][pnode] = Mutex.new unless \
+          @locks[:vnetsync][pnode]
+        }
+
+        @locks[:vnetsync][pnode].synchronize do
+          missing = {}
+          vnets = vnets.dup
+          until vnets.empty?
+            vnet = vnets.shift
+            next if vnet.visibility.include?(pnode) || missing.has_key?(vnet)
+            missing[vnet] = true
+            vnets += vnet.vroutes.values.collect { |vroute| vroute.dstnet }
+          end
+
+          unless missing.empty?
+            nb_pnodes = @daemon_resources.pnodes.length
+            pnode_index = @daemon_resources.pnodes.keys.index(pnode.address.to_s)
+            descs = missing.keys.collect { |vnet|
+              {
+                'name' => vnet.name,
+                'address' => vnet.address.to_string,
+                'opts' => vnet.opts.merge('nb_pnodes' => nb_pnodes, 'pnode_index' => pnode_index),
+                'vroutes' => vnet.vroutes.values.collect { |vroute|
+                  { 'destnetwork' => vroute.dstnet.name, 'gatewaynode' => vroute.gw.to_s }
+                },
+              }
+            }
+            cl = NetAPI::Client.new(pnode.address.to_s, 4568)
+            cl.vnetworks_sync(descs)
+            missing.each_key { |vnet| vnet.visibility << pnode }
           end
-        else
-          block.call
         end
       end
 
@@ -1621,16 +1680,51 @@ module Distem
         @daemon_resources.vnodes_to_dot(output_file,ADMIN_NETWORK_NAME)
       end
 
-      def set_peers_latencies(vnodes, matrix)
+      # Set the latency between each pair of virtual nodes (on their first virtual network interface, by destination address)
+      # ==== Attributes
+      # * +vnodes+ The names of the virtual nodes (Array)
+      # * +matrix+ The latencies in ms, matrix[i][j] is the latency from vnodes[i] to vnodes[j] (0 for none)
+      # * +bandwidths+ A matrix of bandwidths set at once with the latencies (see set_peers_bandwidths)
+      # ==== Returns
+      # false if a matrix does not have the dimensions of vnodes
+      # ==== Exceptions
+      # * +InvalidParameterError+ if a bandwidth cannot be parsed
+      #
+      def set_peers_latencies(vnodes, matrix, bandwidths=nil)
+        matrices = {'latency_filters' => matrix}
+        matrices['bandwidth_filters'] = bandwidths if bandwidths
+        return set_peers_filters(vnodes, matrices)
+      end
+
+      # Set the bandwidth between each pair of virtual nodes (on their first virtual network interface, by destination address)
+      # ==== Attributes
+      # * +vnodes+ The names of the virtual nodes (Array)
+      # * +matrix+ The bandwidths, matrix[i][j] is the rate at 'tc' form (such as "10mbit") from vnodes[i] to vnodes[j] (0 or nil for none)
+      # ==== Returns
+      # false if the matrix does not have the dimensions of vnodes
+      # ==== Exceptions
+      # * +InvalidParameterError+ if a bandwidth cannot be parsed
+      #
+      def set_peers_bandwidths(vnodes, matrix)
+        return set_peers_filters(vnodes, {'bandwidth_filters' => matrix})
+      end
+
+      # Set the filters (VIface attribute => matrix) of the virtual nodes and apply them with one request per physical node
+      def set_peers_filters(vnodes, matrices)
         #sanity check
-        if (vnodes.length == matrix.length)
+        matrices.each_value { |matrix|
+          return false if matrix.length != vnodes.length
           matrix.each { |row|
             if row.length != vnodes.length
               return false
             end
           }
-        else
-          return false
+        }
+        if matrices['bandwidth_filters']
+          matrices['bandwidth_filters'].flatten.each { |rate|
+            next if [0, nil, ''].include?(rate)
+            raise Lib::InvalidParameterError, "bandwidths: #{rate}" unless Resource::Bandwidth.is_valid(rate.to_s)
+          }
         end
         vnodesbyhost = {}
         #group vnodes by pnode
@@ -1639,22 +1733,28 @@ module Distem
           vnode.status = Resource::Status::CONFIGURING
           host = vnode.host.address
           vnodesbyhost[host] = {} if !vnodesbyhost.has_key?(host)
-          vnodesbyhost[host][vnode.name] = {}
-          row = matrix[vnodes.index(name)]
-          rules = {}
-          (0...matrix.length).each { |i|
-            if row[i] != 0
-              dest_vnode = vnode_get(vnodes[i])
-              rules[dest_vnode.vifaces[0].address.to_s] = row[i]
-            end
+          matrices.each_pair { |filters,matrix|
+            row = matrix[vnodes.index(name)]
+            rules = {}
+            (0...matrix.length).each { |i|
+              if ![0, nil, ''].include?(row[i])
+                dest_vnode = vnode_get(vnodes[i])
+                rules[dest_vnode.vifaces[0].address.to_s] = row[i]
+              end
+            }
+            vnodesbyhost[host][filters] = {} if !vnodesbyhost[host].has_key?(filters)
+            vnodesbyhost[host][filters][vnode.name] = vnode.vifaces[0].send("#{filters}=", rules)
           }
-          vnodesbyhost[host][vnode.name] = vnode.vifaces[0].latency_filters = rules
         }
         tids = []
-        vnodesbyhost.each_pair { |pnode,vnodeshash|
+        vnodesbyhost.each_pair { |pnode,filters|
           tids << Thread.new {
             cl = NetAPI::Client.new(pnode, 4568)
-            cl.set_peers_latencies(nil, vnodeshash)
+            if filters['latency_filters']
+              cl.set_peers_latencies(nil, filters['latency_filters'], filters['bandwidth_filters'])
+            else
+              cl.set_peers_bandwidths(nil, filters['bandwidth_filters'])
+            end
           }
         }
         tids.each { |tid| tid.join }
@@ -1677,16 +1777,8 @@ module Distem
             end
           end
         }
-        data = Base64.encode64(Zlib::Deflate.deflate(results.join("\n")))
-        w = Distem::Lib::Synchronization::SlidingWindow.new(WINDOW_SIZE)
-        @daemon_resources.pnodes.each_value {|pnode|
-          block = Proc.new {
-            cl = NetAPI::Client.new(pnode.address.to_s, 4568)
-            cl.set_global_etchosts(data)
-          }
-          w.add(block)
-        }
-        w.run
+        data = results.join("\n")
+        broadcast_push('set_global_etchosts', [data], Digest::SHA1.hexdigest(data))
       end
 
       def vmem_update(vnodename, desc)
@@ -1699,6 +1791,9 @@ module Distem
         end
       end
 
+      # Fill the neighbor tables of every vnode with the addresses of the others
+      # ==== Returns
+      # Hash, vnode name => { 'entries' => number of entries set, 'time' => duration in seconds } (for the vnodes of the pnodes that did not already have the table)
       def set_global_arptable(param = nil, arp_file = nil)
         results = []
         @daemon_resources.vnodes.each_value {|vnode|
@@ -1708,17 +1803,12 @@ module Distem
             end
           }
         }
-        data = Base64.encode64(Zlib::Deflate.deflate(results.join("\n")))
+        data = results.join("\n")
         arp_file = '/tmp/fullarptable'
-        w = Distem::Lib::Synchronization::SlidingWindow.new(WINDOW_SIZE)
-        @daemon_resources.pnodes.each_value {|pnode|
-          block = Proc.new {
-            cl = NetAPI::Client.new(pnode.address.to_s, 4568)
-            cl.set_global_arptable(data, arp_file)
-          }
-          w.add(block)
-        }
-        w.run
+        results = broadcast_push('set_global_arptable', [data, arp_file], Digest::SHA1.hexdigest(data + arp_file))
+        timings = {}
+        results.each_value { |result| timings.merge!(result['result']) if result['result'].is_a?(Hash) }
+        return timings
       end
 
       def wait_vnodes(opts)
@@ -1749,32 +1839,79 @@ module Distem
           }
         end
 
-        w = Distem::Lib::Synchronization::SlidingWindow.new(WINDOW_SIZE)
-        ret = {}
+        targets = nil
         if vnodesbyhost
+          targets = {}
           vnodesbyhost.each_pair { |pnodeaddress,vn|
-            block = Proc.new {
-              cl = NetAPI::Client.new(pnodeaddress, 4568)
-              ret[pnodeaddress] = cl.wait_vnodes({'port' => port, 'vnodes' => vn, 'timeout' => timeout})
-            }
-            w.add(block)
+            targets[pnodeaddress] = [{'port' => port, 'vnodes' => vn, 'timeout' => timeout}]
           }
+        end
+        ret = Broadcast.call('wait_vnodes', [{'port' => port, 'vnodes' => nil, 'timeout' => timeout}],
+          targets || broadcast_targets)
+
+        return ret.values.all? { |result| result['result'] == ['true'] } ? ['true'] : ['false']
+      end
+
+      # Wait for a port to open on the vnodes, each vnode is reported as soon as its pnode saw its port open
+      # ==== Attributes
+      # * +opts+ Hash, 'port' (22 by default), 'timeout' (in seconds, 600 by default) and 'vnodes' (names, nil for every vnode)
+      # ==== Yields
+      # { 'vnode' => name, 'status' => 'ready' } for each vnode as soon as its port opened, then 'timeout' for the ones whose port did not open ('error' with an 'error' message if their pnode failed)
+      def wait_vnodes_stream(opts)
+        opts ||= {}
+        port = opts['port'] || 22
+        timeout = opts['timeout'] || 600
+        if opts['vnodes']
+          vnodes = (opts['vnodes'].is_a?(Array) ? opts['vnodes'] : [ opts['vnodes'] ]).collect { |name| vnode_get(name) }
         else
-          @daemon_resources.pnodes.each_value {|pnode|
-            block = Proc.new {
-              cl = NetAPI::Client.new(pnode.address.to_s, 4568)
-              ret[pnode.address.to_s] = cl.wait_vnodes({'port' => port, 'vnodes' => nil, 'timeout' => timeout})
-            }
-            w.add(block)
-          }
+          vnodes = @daemon_resources.vnodes.values.select { |vnode| vnode.host }
         end
+        vnodesbyhost = Hash.new { |hash,address| hash[address] = [] }
+        vnodes.each { |vnode|
+          raise Lib::UninitializedResourceError, vnode.name unless vnode.host
+          vnodesbyhost[vnode.host.address.to_s] << vnode.name
+        }
+        lock = Mutex.new
+        w = Distem::Lib::Synchronization::SlidingWindow.new(WINDOW_SIZE)
+        vnodesbyhost.each_pair { |address,names|
+          w.add(Proc.new {
+            reported = []
+            begin
+              Distem.client(address, 4568) do |cl|
+                cl.wait_vnodes_stream('port' => port, 'timeout' => timeout, 'vnodes' => names) { |event|
+                  reported << event['vnode']
+                  lock.synchronize { yield event }
+                }
+              end
+            rescue Lib::DistemError, StandardError => e
+              lock.synchronize {
+                (names - reported).each { |name| yield({ 'vnode' => name, 'status' => 'error', 'error' => e.to_s }) }
+              }
+            end
+          })
+        }
         w.run
-
-        return ret.values.include?(false) ? ['false'] : ['true']
       end
 
       protected
 
+      # The targets of Broadcast: every pnode
+      def broadcast_targets
+        targets = {}
+        @daemon_resources.pnodes.each_key { |address| targets[address] = nil }
+        return targets
+      end
+
+      # Push a content to every pnode with Broadcast, returns the results (see Broadcast.call)
+      def broadcast_push(method, args, digest)
+        results = Broadcast.call(method, args, broadcast_targets, digest)
+        errors = Broadcast.errors(results)
+        unless errors.empty?
+          raise Lib::ResourceError, errors.collect { |target,error| "#{target}: #{error}" }.join('; ')
+        end
+        return results
+      end
+
       # Get a new version of the hash with downcase keys
       # ==== Attributes
       # * +hash+ The Hash object
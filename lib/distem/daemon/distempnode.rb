@@ -4,13 +4,18 @@ require 'ipaddress'
 require 'json'
 require 'pp'
 require 'tempfile'
-require 'zlib'
-require 'base64'
 require 'cgi'
 
 module Distem
   module Daemon
     class DistemPnode
+      # The methods that can be called with Broadcast
+      BROADCAST_METHODS = ['set_global_etchosts', 'set_global_arptable', 'wait_vnodes']
+      # The number of vnodes whose neighbor tables are set at the same time
+      ARPTABLE_WINDOW = 32
+      # The number of commands of vnodes_execute running at the same time
+      EXECUTE_WINDOW = 100
+
       # The NodeConfig object that allows to apply virtual resources specifications on physical nodes
       attr_reader  :node_config
 
@@ -30,6 +35,8 @@ module Distem
         @vnetworks_linked_to_bridge = {}
         @default_network_interface = Lib::NetTools.get_default_iface
         @default_network_gw = Lib::NetTools.get_default_gateway
+        @broadcast_digests = {}
+        @broadcast_lock = Mutex.new
       end
 
 
@@ -37,7 +44,7 @@ module Distem
       # This step have to be performed to be able to create virtual nodes on a machine
       # ==== Attributes
       # * +target+ the name/address of the physical machine
-      # * +properties+ async,max_vifaces,cpu_algorithm
+      # * +properties+ async,max_vifaces,cpu_algorithm,network_algorithm
       # ==== Returns
       # Resource::PNode object
       # ==== Exceptions
@@ -66,14 +73,26 @@ module Distem
         pnode = pnode_get(target)
 
         if desc['algorithms']
+          ret = {'algorithms' => {}}
           if desc['algorithms']['cpu']
             algo = desc['algorithms']['cpu'].upcase
             raise InvalidParameterError "algorithms/cpu" unless \
               [Algorithm::CPU::GOV.upcase,
-              Algorithm::CPU::HOGS.upcase].include?(algo)
+              Algorithm::CPU::HOGS.upcase,
+              Algorithm::CPU::QUOTA.upcase].include?(algo)
             pnode.algorithms[:cpu] = algo
-            return {'algorithms' => {'cpu'=> algo }}
+            ret['algorithms']['cpu'] = algo
+          end
+          if desc['algorithms']['network']
+            algo = desc['algorithms']['network'].upcase
+            raise Lib::InvalidParameterError, "algorithms/network" unless \
+              [Algorithm::Network::TC.upcase,
+              Algorithm::Network::BPF.upcase,
+              Algorithm::Network::HTB.upcase].include?(algo)
+            pnode.algorithms[:network] = algo
+            ret['algorithms']['network'] = algo
           end
+          return ret
         end
       end
 
@@ -915,6 +934,24 @@ module Distem
         end
       end
 
+      # Create several virtual networks then their virtual routes (see DistemCoordinator#vnetworks_sync), the virtual networks that already exist are kept
+      # ==== Attributes
+      # * +vnetworks+ Array of Hash with the name, the address, the opts and the vroutes (Array of Hash with the destnetwork and the gatewaynode) of each virtual network
+      # ==== Returns
+      # Array of Resource::VNetwork objects
+      #
+      def vnetworks_sync(vnetworks)
+        ret = vnetworks.collect { |desc|
+          vnetwork_get(desc['name'],false) || vnetwork_create(desc['name'],desc['address'],desc['opts'])
+        }
+        vnetworks.each { |desc|
+          (desc['vroutes'] || []).each { |vroute|
+            vroute_create(desc['name'],vroute['destnetwork'],vroute['gatewaynode'])
+          }
+        }
+        return ret
+      end
+
       # Delete the virtual network
       # ==== Returns
       # Resource::VNetwork object
@@ -1021,12 +1058,36 @@ module Distem
         end
       end
 
-      def set_peers_latencies(vnodes, matrix)
+      # Set the latencies by destination of virtual nodes (see DistemCoordinator#set_peers_latencies)
+      # ==== Attributes
+      # * +vnodes+ Unused
+      # * +matrix+ The latencies by destination of each virtual node (Hash, vnode name => Hash destination => latency)
+      # * +bandwidths+ The bandwidths by destination of each virtual node, set at once with the latencies (Hash, vnode name => Hash destination => rate)
+      #
+      def set_peers_latencies(vnodes, matrix, bandwidths=nil)
+        matrices = {'latency_filters' => matrix}
+        matrices['bandwidth_filters'] = bandwidths if bandwidths
+        return set_peers_filters(matrices)
+      end
+
+      # Set the bandwidths by destination of virtual nodes (see DistemCoordinator#set_peers_bandwidths)
+      # ==== Attributes
+      # * +vnodes+ Unused
+      # * +matrix+ The bandwidths by destination of each virtual node (Hash, vnode name => Hash destination => rate)
+      #
+      def set_peers_bandwidths(vnodes, matrix)
+        return set_peers_filters({'bandwidth_filters' => matrix})
+      end
+
+      # Set the filters (VIface attribute => Hash vnode name => filters) of the virtual nodes, each one is reconfigured once
+      def set_peers_filters(matrices)
         tids = []
-        matrix.each_pair { |vnode_name,destinations|
+        matrices.values.collect { |matrix| matrix.keys }.flatten.uniq.each { |vnode_name|
           tids << Thread.new {
             vnode = vnode_get(vnode_name)
-            vnode.vifaces[0].latency_filters = destinations
+            matrices.each_pair { |filters,matrix|
+              vnode.vifaces[0].send("#{filters}=", matrix[vnode_name]) if matrix.has_key?(vnode_name)
+            }
             if vnode.status == Resource::Status::RUNNING
               vnode.status = Resource::Status::CONFIGURING
               @node_config.vnode_reconfigure(vnode)
@@ -1038,7 +1099,7 @@ module Distem
         return true
       end
 
-      def set_global_etchosts(compressed_data)
+      def set_global_etchosts(data)
         shared_fs = []
         private_fs = []
         @node_config.vplatform.vnodes.each_value { |vnode|
@@ -1048,7 +1109,6 @@ module Distem
             private_fs << vnode
           end
         }
-        data = Zlib::Inflate.inflate(Base64.decode64(compressed_data))
         @node_config.set_global_etchosts(shared_fs.first, data) if !shared_fs.empty?
         private_fs.each {|vnode|
           @node_config.set_global_etchosts(vnode, data)
@@ -1065,6 +1125,7 @@ module Distem
             end
           }
         }
+        return nil
       end
 
       def get_default_iface_from_vnode(vnode)
@@ -1074,7 +1135,13 @@ module Distem
         return ifadm.empty? ? vnode.vifaces[0] : ifadm[0]
       end
 
-      def set_global_arptable(compressed_data, arp_file)
+      # Fill the neighbor (ARP) tables of the running vnodes, the table is also written in a file of their filesystem. The entries of a vnode are set by rtnetlink from its network namespace (see Lib::NetTools.set_neighbors), ARPTABLE_WINDOW vnodes at a time
+      # ==== Attributes
+      # * +data+ The entries, "mac address" lines
+      # * +arp_file+ The path of the file in the vnodes
+      # ==== Returns
+      # Hash, vnode name => { 'entries' => number of entries set, 'time' => duration in seconds }
+      def set_global_arptable(data, arp_file)
         shared_fs = []
         private_fs = []
         @node_config.vplatform.vnodes.each_value { |vnode|
@@ -1084,66 +1151,131 @@ module Distem
             private_fs << vnode
           end
         }
-        data = Zlib::Inflate.inflate(Base64.decode64(compressed_data))
         @node_config.set_global_arptable(shared_fs.first, data, arp_file) if !shared_fs.empty?
         private_fs.each {|vnode|
           @node_config.set_global_arptable(vnode, data, arp_file)
         } if !private_fs.empty?
 
-        w = Distem::Lib::Synchronization::SlidingWindow.new(100)
+        entries = data.to_s.split("\n").collect { |line| line.split }.select { |fields| fields.size == 2 }.collect { |mac,address|
+          [address, mac, IPAddress::IPv4.new(address).to_u32]
+        }
+        timings = {}
+        errors = {}
+        lock = Mutex.new
+        w = Distem::Lib::Synchronization::SlidingWindow.new(ARPTABLE_WINDOW)
         (shared_fs + private_fs).each { |vnode|
-          w.add("ssh -q -o StrictHostKeyChecking=no #{get_default_iface_from_vnode(vnode).address.address.to_s} \"arp -f #{arp_file} 2>/dev/null\"")
+          next unless vnode.status == Resource::Status::RUNNING
+          w.add(Proc.new {
+            start = Time.now
+            begin
+              pid = LXCWrapper::Command.pid(vnode.name)
+              raise Lib::UninitializedResourceError, vnode.name unless pid
+              nb = Lib::NetTools.set_neighbors(pid, vnode.vifaces, entries)
+              lock.synchronize { timings[vnode.name] = { 'entries' => nb, 'time' => Time.now - start } }
+            rescue Exception => e
+              lock.synchronize { errors[vnode.name] = e.to_s }
+            end
+          })
         }
         w.run
+        unless errors.empty?
+          raise Lib::ResourceError, errors.collect { |name,error| "#{name}: #{error}" }.join('; ')
+        end
+        return timings
       end
 
+      # Execute a command on a set of vnodes (see Node::Executor)
+      # ==== Returns
+      # Hash, vnode name => { 'out' => String, 'err' => String, 'success' => 'ok' or 'ko' }
       def vnodes_execute(names, command)
-        w = Distem::Lib::Synchronization::SlidingWindow.new(100)
-        names.each { |vnode_name|
-          vnode = vnode_get(vnode_name)
-          w.add("ssh -q -o StrictHostKeyChecking=no #{get_default_iface_from_vnode(vnode).address.address.to_s} \"#{command}\"", vnode_name)
+        ret = {}
+        vnodes_execute_stream(names, command) { |chunk|
+          res = (ret[chunk['vnode']] ||= { 'out' => '', 'err' => '' })
+          if chunk['stream'] == 'exit'
+            res['err'] << chunk['error'] if chunk['error']
+            res['success'] = ((chunk['status'] == 0) && res['err'].empty?) ? 'ok' : 'ko'
+          else
+            res[chunk['stream']] << chunk['data']
+          end
         }
-        w.run
-        return w.results
+        return ret
       end
 
+      # Execute a command on a set of vnodes, in their containers, EXECUTE_WINDOW vnodes at a time
+      # ==== Attributes
+      # * +names+ The names of the vnodes
+      # * +command+ The command
+      # * +timeout+ The time (in seconds) after which the command is killed, nil for no limit
+      # ==== Yields
+      # Every chunk of output as soon as it is read, then the end of the command on each vnode (see Node::Executor#run), a vnode that is not running only gets its end with an 'error'
+      def vnodes_execute_stream(names, command, timeout = nil)
+        running, stopped = names.collect { |name| vnode_get(name) }.partition { |vnode| vnode.status == Resource::Status::RUNNING }
+        stopped.each { |vnode| yield({ 'vnode' => vnode.name, 'stream' => 'exit', 'error' => "#{vnode.name} is not running" }) }
+        Node::Executor.new(EXECUTE_WINDOW, timeout).run(running.collect { |vnode| vnode.name }, command) { |chunk| yield chunk }
+      end
+
+      # Run a call sent along a tree by Daemon::Broadcast, while it is relayed to the subtrees of the descendants of this pnode
+      # ==== Attributes
+      # * +method+ The name of the method (see BROADCAST_METHODS)
+      # * +args+ The arguments of the call
+      # * +target+ The name of this pnode in +targets+
+      # * +targets+ The targets of the subtree of this pnode (Hash, target => arguments or nil for +args+)
+      # * +digest+ The digest of the content sent (see Daemon::Broadcast.call)
+      # * +arity+ The arity of the tree
+      # ==== Returns
+      # Hash, target => result (see Daemon::Broadcast.call)
+      #
+      def broadcast(method, args, target, targets, digest = nil, arity = Broadcast::ARITY)
+        raise Lib::InvalidParameterError, method unless BROADCAST_METHODS.include?(method)
+        own = targets.delete(target) || args
+        relay = Thread.new { Broadcast.call(method, args, targets, digest, arity.to_i) }
+        ret = { target => broadcast_run(method, own, digest) }
+        return ret.merge(relay.value)
+      end
+
+      # Wait for a port to open on the vnodes
+      # ==== Attributes
+      # * +opts+ Hash, 'port', 'timeout' (in seconds) and 'vnodes' (names, nil for every vnode of the pnode)
+      # ==== Returns
+      # ['true'] if the port opened on every vnode before the timeout, ['false'] otherwise
       def wait_vnodes(opts)
-        port = opts['port']
-        timeout = opts['timeout']
-        vnodes = []
-        if opts['vnodes']
-          vnodes = opts['vnodes'].collect { |vnode| get_default_iface_from_vnode(vnode_get(vnode)).address.address.to_s }
-        else
-          @node_config.vplatform.vnodes.each_value { |vnode|
-            vnodes << get_default_iface_from_vnode(vnode).address.address.to_s
-          }
-        end
-        finished = false
-        begin
-          Timeout::timeout(timeout) {
-            while !finished
-              tmp = []
-              vnodes.each { |ip|
-                if !port_open?(ip,port)
-                  tmp << ip
-                end
-              }
-              if !tmp.empty?
-                vnodes = tmp
-                sleep(10)
-              else
-                finished = true
-              end
-            end
-          }
-        rescue Timeout::Error
-          return ['false']
-        end
-        return ['true']
+        ready = true
+        wait_vnodes_stream(opts) { |event| ready = false if event['status'] != 'ready' }
+        return [ready.to_s]
+      end
+
+      # Wait for a port to open on the vnodes, probing them all at once (see Lib::PortProber)
+      # ==== Attributes
+      # * +opts+ See wait_vnodes
+      # ==== Yields
+      # { 'vnode' => name, 'status' => 'ready' } for each vnode as soon as its port opened, then { 'vnode' => name, 'status' => 'timeout' } for each vnode whose port did not open
+      def wait_vnodes_stream(opts)
+        vnodes = opts['vnodes'] ? opts['vnodes'].collect { |name| vnode_get(name) } : @node_config.vplatform.vnodes.values
+        targets = {}
+        vnodes.each { |vnode| targets[get_default_iface_from_vnode(vnode).address.address.to_s] = vnode.name }
+        left = Lib::PortProber.new(opts['port'], opts['timeout']).run(targets) { |name|
+          yield({ 'vnode' => name, 'status' => 'ready' })
+        }
+        left.each { |name| yield({ 'vnode' => name, 'status' => 'timeout' }) }
       end
 
       protected
 
+      # Run a broadcast call, unless this content was already pushed to the current vnodes
+      def broadcast_run(method, args, digest)
+        state = [digest, @node_config.vplatform.vnodes.keys.sort]
+        @broadcast_lock.synchronize {
+          return { 'status' => 'skipped' } if digest && (@broadcast_digests[method] == state)
+        }
+        begin
+          result = send(method, *args)
+        rescue Exception => e
+          return { 'status' => 'error', 'error' => e.to_s }
+        end
+        @broadcast_lock.synchronize { @broadcast_digests[method] = state } if digest
+        return { 'status' => 'ok', 'result' => result }
+      end
+
 
       # Guess that we are in a local context
       # ==== Attributes
@@ -1239,16 +1371,6 @@ module Distem
       def destroy(resource)
         @node_config.destroy(resource)
       end
-
-      def port_open?(ip, port)
-        begin
-          s = TCPSocket.new(ip, port)
-          s.close
-          return true
-        rescue Errno::ECONNREFUSED, Errno::EHOSTUNREACH, Errno::ETIMEDOUT
-          return false
-        end
-      end
     end
   end
 end
@@ -15,6 +15,58 @@ module Distem
       # for a root interface on which a bridge is plugged on
       @@br_info = {}
 
+      # Run the block with a rtnetlink socket (NetworkExtension::RTNetlink), the requests made in the block are sent to the kernel in a single batch
+      # ==== Attributes
+      # * +netns+ The network namespace to open the socket in (i.e. "/proc/<pid>/ns/net"), the one of the daemon if nil
+      # ==== Returns
+      # The value returned by the block
+      def self.rtnetlink(netns = nil)
+        nl = NetworkExtension::RTNetlink.new(netns)
+        begin
+          return nl.batch { yield nl }
+        ensure
+          nl.close
+        end
+      end
+
+      # Set the permanent entries of the neighbor (ARP) tables of the interfaces of a vnode, in a single batch sent from its network namespace. An entry is set on the interface whose virtual network contains its address
+      # ==== Attributes
+      # * +pid+ The pid of a process of the vnode
+      # * +vifaces+ The VIfaces of the vnode
+      # * +entries+ Array of [IP address, MAC address, IP address as an Integer]
+      # ==== Returns
+      # The number of entries set
+      def self.set_neighbors(pid, vifaces, entries)
+        nb = 0
+        rtnetlink("/proc/#{pid}/ns/net") { |nl|
+          vifaces.each { |viface|
+            next unless viface.vnetwork && viface.address
+            network = viface.vnetwork.address.network_u32
+            mask = viface.vnetwork.address.prefix.to_u32
+            own = viface.address.to_u32
+            entries.each { |address,mac,u32|
+              next if (u32 & mask) != network || u32 == own
+              nl.neigh_add(viface.name, address, mac)
+              nb += 1
+            }
+          }
+        }
+        return nb
+      end
+
+      # Gets the qdiscs of a network interface
+      # ==== Attributes
+      # * +iface+ The network interface name (String)
+      # ==== Returns
+      # Array of Hash ('kind', 'handle', 'parent'), empty if the interface does not exist
+      def self.get_qdiscs(iface)
+        begin
+          return rtnetlink { |nl| nl.qdiscs(iface) }
+        rescue Errno::ENODEV
+          return []
+        end
+      end
+
       # Gets the name of the default network interface used for network communications
       # ==== Returns
       # String object
@@ -88,59 +140,60 @@ module Distem
       end
 
       def self.set_bridge(root_interface, default_gw)
-        str = Shell.run("/bin/ip link show") #TODO: Getting only iface name and no garbage
         bridge_name = "br_#{root_interface}"
-        unless str.include?(bridge_name)
-          @@br_info[bridge_name] = [root_interface, self.get_iface_addr(root_interface), self.get_netmask(root_interface)]
+        rtnetlink do |nl|
+          return nil if nl.links.any? { |link| link['name'] == bridge_name }
+
           # needs to be done before we break eth0
-          cfg = self.get_iface_config(root_interface)
+          addrs = nl.addrs(root_interface)
+          cfg = addrs.first
+          @@br_info[bridge_name] = [root_interface, (cfg ? cfg['address'] : ''), (cfg ? cfg['prefixlen'].to_s : '')]
           Shell.run("ethtool -G #{root_interface} rx 4096 tx 4096 || true")
-          #Shell.run("/bin/ip link set mtu 1600 dev #{root_interface}")
-
-          Shell.run("brctl addbr #{bridge_name}")
-          Shell.run("brctl setfd #{bridge_name} 0")
-          Shell.run("brctl setageing #{bridge_name} 3000000")
-          Shell.run("/bin/ip addr add dev #{bridge_name} #{cfg}")
-          Shell.run("/bin/ip link set dev #{bridge_name} promisc on")
-          Shell.run("/bin/ip link set dev #{bridge_name} up")
-          Shell.run("brctl addif #{bridge_name} #{root_interface}")
-          Shell.run("/bin/ip addr flush dev #{root_interface}")
-          Shell.run("/bin/ip link set up dev #{root_interface}")
-          # Set the default route only if the default interface has been added into the bridge, in
-          # this case the default gateway is passed as a parameter to set_bridge
-          if default_gw
-            iface = self.get_default_iface()
-            unless iface.empty?
-              Shell.run("/bin/ip route del default dev #{iface}")
-            end
-            Shell.run("/bin/ip route add default dev #{bridge_name} via #{default_gw}")
+
+          nl.link_add(bridge_name, 'bridge', 'forward_delay' => 0, 'ageing_time' => 3000000)
+          nl.addr_add(bridge_name, "#{cfg['address']}/#{cfg['prefixlen']}", 'broadcast' => cfg['broadcast']) if cfg
+          nl.link_set(bridge_name, 'promisc' => true, 'up' => true)
+          nl.link_set(root_interface, 'master' => bridge_name)
+          # secondary addresses first, they are removed with the primary one
+          addrs.reverse.each { |addr| nl.addr_del(root_interface, "#{addr['address']}/#{addr['prefixlen']}") }
+          nl.link_set(root_interface, 'up' => true)
+        end
+        # Set the default route only if the default interface has been added into the bridge, in
+        # this case the default gateway is passed as a parameter to set_bridge
+        if default_gw
+          iface = self.get_default_iface()
+          unless iface.empty?
+            Shell.run("/bin/ip route del default dev #{iface}")
           end
-          return bridge_name
-        else
-          return nil
+          Shell.run("/bin/ip route add default dev #{bridge_name} via #{default_gw}")
         end
+        return bridge_name
       end
 
       # Unset the bridge and restore the default interface, if possible
       def self.unset_bridge(brname, default_gw)
         interface, ip, netmask = @@br_info[brname]
         @@br_info.delete(brname)
-        cmd = ""
-        Dir.glob("/sys/class/net/#{brname}/brif/*").each { |i|
-          cmd += "brctl delif #{brname} #{File.basename(i)};"
-        }
-        cmd += "/bin/ip link set #{brname} down;"
-        cmd += "brctl delbr #{brname};"
-        cmd += "/bin/ip addr add #{ip}/#{netmask} dev #{interface}"
+        # the interfaces are released when the bridge is deleted
+        rtnetlink do |nl|
+          nl.link_set(brname, 'up' => false)
+          nl.link_del(brname)
+          nl.addr_add(interface, "#{ip}/#{netmask}") unless ip.to_s.empty?
+        end
         if default_gw
-          cmd += ";ip route add default via #{default_gw} dev #{interface}"
+          Shell.run("ip route add default via #{default_gw} dev #{interface}")
         end
-        Shell.run(cmd)
       end
 
-      # Set up the IFB module
+      # Set up the IFB module and its devices (ifb0 to ifb<nb-1>)
       def self.set_ifb(nb=64)
-        Shell.run("modprobe ifb numifbs=#{nb}")
+        Shell.run("modprobe ifb numifbs=0")
+        rtnetlink do |nl|
+          existing = nl.links.collect { |link| link['name'] }
+          nb.times do |i|
+            nl.link_add("ifb#{i}", 'ifb') unless existing.include?("ifb#{i}")
+          end
+        end
       end
 
       # Set up the ARP cache
@@ -160,7 +213,7 @@ module Distem
       # Create a new NIC network interface on the physical node (used to communicate with the VNodes, see Daemon::Admin)
       def self.set_new_nic(address,netmask,iface)
         new_iface = "#{iface}:#{@@nic_count}"
-        Shell.run("/bin/ip addr add #{address}/#{netmask} dev #{new_iface}")
+        rtnetlink { |nl| nl.addr_add(iface, "#{address}/#{netmask}", 'label' => new_iface) }
         @@nic_count += 1
         return new_iface
       end
@@ -179,11 +232,12 @@ module Distem
       # ==== Attributes
       # * +max_vifaces+ the maximum number of virtual network interfaces that'll be set on this physical machine
       # * +set_bridge+ boolean specifying if a bridge has to be created
-      def self.set_resource(max_vifaces,set_bridge)
+      # * +ifb+ boolean specifying if the ifb devices have to be created
+      def self.set_resource(max_vifaces,set_bridge,ifb=true)
         disable_ipv6()
         set_arp_cache()
         set_bridge() if set_bridge
-        set_ifb(max_vifaces)
+        set_ifb(max_vifaces) if ifb
       end
 
       # Gets the physical name of a virtual network interface
@@ -260,19 +314,15 @@ module Distem
       def self.create_vxlan_interface(id, mcast_id, address,netmask,root_interface)
         vxlan_iface = VXLAN_INTERFACE_PREFIX + id.to_s
         bridge = VXLAN_BRIDGE_PREFIX + id.to_s
-        # First, we set up the VXLAN interface
+        # First, we set up the VXLAN interface, then we create a bridge and add the VXLAN interface into it
         mcast_addr = IPAddress::IPv4::parse_u32(mcast_id + IPAddress("239.192.0.0").u32).address
-        Shell.run("/bin/ip link add #{vxlan_iface} type vxlan id #{id} group #{mcast_addr} ttl 10 dev #{root_interface} dstport 4789")
-        Shell.run("/bin/ip link set up dev #{vxlan_iface}")
-        # Then, we create a bridge
-        Shell.run("brctl addbr #{bridge}")
-        Shell.run("brctl setfd #{bridge} 0")
-        Shell.run("brctl setageing #{bridge} 3000000")
-        Shell.run("/bin/ip link set dev #{bridge} promisc on")
-        Shell.run("/bin/ip link set dev #{bridge} up")
-        # And we add the VXLAN interface into the bridge
-        Shell.run("brctl addif #{bridge} #{vxlan_iface}")
-        Shell.run("/bin/ip link set up dev #{vxlan_iface}")
+        rtnetlink do |nl|
+          nl.link_add(vxlan_iface, 'vxlan', 'id' => id.to_i, 'group' => mcast_addr, 'ttl' => 10,
+                      'dev' => root_interface, 'dstport' => 4789)
+          nl.link_add(bridge, 'bridge', 'forward_delay' => 0, 'ageing_time' => 3000000)
+          nl.link_set(bridge, 'promisc' => true, 'up' => true)
+          nl.link_set(vxlan_iface, 'master' => bridge, 'up' => true)
+        end
       end
 
       # Remove a VXLAN interface and its related bridge
@@ -281,10 +331,11 @@ module Distem
       def self.remove_vxlan_interface(id)
         vxlan_iface = VXLAN_INTERFACE_PREFIX + id.to_s
         bridge = VXLAN_BRIDGE_PREFIX + id.to_s
-        Shell.run("brctl delif #{bridge} #{vxlan_iface}")
-        Shell.run("/bin/ip link del #{vxlan_iface}")
-        Shell.run("/bin/ip link set down dev #{bridge}")
-        Shell.run("brctl delbr #{bridge}")
+        rtnetlink do |nl|
+          nl.link_del(vxlan_iface)
+          nl.link_set(bridge, 'up' => false)
+          nl.link_del(bridge)
+        end
       end
     end
 
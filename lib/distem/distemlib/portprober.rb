@@ -0,0 +1,134 @@
+require 'socket'
+
+module Distem
+  module Lib
+
+    # Wait for a TCP port to open on many hosts at once. The connections are opened without blocking and their completion is awaited with a single select on every socket in flight (at most MAX_INFLIGHT, within the limit of open files of the process), so a host is reported as soon as its port accepts a connection, whatever the number of hosts still booting
+    class PortProber
+      # The maximum number of connections in flight
+      MAX_INFLIGHT = 1000
+      # The number of files left to the rest of the process when the limit of open files is lower than MAX_INFLIGHT
+      FD_MARGIN = 64
+      # The time after which a connection that got no answer (i.e. the host is not up yet) is tried again
+      CONNECT_TIMEOUT = 2
+      # The time before trying again a host that refused the connection
+      RETRY_DELAY = 0.5
+
+      # An address to probe
+      Target = Struct.new(:address, :tag, :socket, :deadline, :next_try, :done) # :nodoc:
+
+      # ==== Attributes
+      # * +port+ The TCP port
+      # * +timeout+ The time (in seconds) after which the probing stops, nil for no limit
+      def initialize(port, timeout = nil)
+        @port = port.to_i
+        @timeout = timeout
+        files = Process.getrlimit(:NOFILE)[0]
+        @max_inflight = [[MAX_INFLIGHT, files - FD_MARGIN].min, 1].max
+      end
+
+      # Probe the addresses until their port opens
+      # ==== Attributes
+      # * +targets+ Hash, IP address => tag (i.e. the name of the vnode)
+      # ==== Yields
+      # The tag of each address as soon as its port opened
+      # ==== Returns
+      # Array of the tags of the addresses whose port did not open before the timeout
+      def run(targets)
+        stop = @timeout ? Time.now + @timeout.to_f : nil
+        now = Time.now
+        pending = targets.collect { |address,tag| Target.new(address, tag, nil, nil, now) }
+        until pending.empty?
+          now = Time.now
+          break if stop && now >= stop
+
+          inflight = pending.count { |target| target.socket }
+          connected = []
+          pending.each { |target|
+            break if inflight >= @max_inflight
+            next if target.socket || target.next_try > now
+            case connect(target, now)
+            when :connected
+              connected << target
+            when :inflight
+              inflight += 1
+            end
+          }
+          connected.each { |target|
+            target.done = true
+            yield target.tag
+          }
+
+          sockets = {}
+          pending.each { |target|
+            next unless target.socket
+            if target.deadline <= now
+              retry_later(target, now)
+            else
+              sockets[target.socket] = target
+            end
+          }
+          times = sockets.values.collect { |target| target.deadline }
+          if sockets.size < @max_inflight
+            times += pending.collect { |target| target.next_try unless target.socket || target.done }.compact
+          end
+          times << stop if stop
+          wait = times.empty? ? 0 : [[times.min - now, 0].max, 1].min
+          if sockets.empty?
+            sleep(wait)
+          else
+            _, writable, = IO.select(nil, sockets.keys, nil, wait)
+            (writable || []).each { |socket|
+              target = sockets[socket]
+              if socket.getsockopt(Socket::SOL_SOCKET, Socket::SO_ERROR).int == 0
+                close(target)
+                target.done = true
+                yield target.tag
+              else
+                retry_later(target, Time.now, RETRY_DELAY)
+              end
+            }
+          end
+          pending.reject! { |target| target.done }
+        end
+        return pending.collect { |target| target.tag }
+      ensure
+        (pending || []).each { |target| close(target) }
+      end
+
+      protected
+
+      # Start a connection, returns :inflight, :connected (at once, i.e. on a local address) or :failed
+      def connect(target, now)
+        socket = nil
+        begin
+          #EMFILE or ENFILE if the other files of the process filled up the limit
+          socket = Socket.new(Socket::AF_INET, Socket::SOCK_STREAM, 0)
+          ret = socket.connect_nonblock(Socket.sockaddr_in(@port, target.address), :exception => false)
+        rescue SystemCallError
+          socket.close if socket
+          target.next_try = now + RETRY_DELAY
+          return :failed
+        end
+        if ret == 0
+          socket.close
+          return :connected
+        end
+        target.socket = socket
+        target.deadline = now + CONNECT_TIMEOUT
+        return :inflight
+      end
+
+      def retry_later(target, now, delay = 0)
+        close(target)
+        target.next_try = now + delay
+      end
+
+      def close(target)
+        target.socket.close if target.socket
+        target.socket = nil
+      end
+    end
+
+  end
+end
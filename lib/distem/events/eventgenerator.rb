@@ -94,15 +94,8 @@ module Distem
         generator_parameters = @generator_desc[generator]
         random_generator = @random_generators[generator]
 
-        if generator_parameters['distribution'] == 'uniform'
-          return generator_parameters['min'].to_f +
-              (generator_parameters['max'].to_f - generator_parameters['min'].to_f) * random_generator.rand_U01
-
-        elsif generator_parameters['distribution'] == 'exponential'
-          return -Math::log(random_generator.rand_U01) / generator_parameters['rate'].to_f
-
-        elsif generator_parameters['distribution'] == 'weibull'
-          return generator_parameters['scale'] * ( (-Math::log(random_generator.rand_U01)) ** (1.0 / generator_parameters['shape'].to_f) )
+        if ['uniform','exponential','weibull'].include?(generator_parameters['distribution'])
+          return random_generator.next_value(generator_parameters['distribution'], generator_parameters)
 
         elsif generator_parameters['distribution'] == 'always'
           # This case could be used for churn, when one wants a resource
@@ -11,6 +11,31 @@ module Distem
       def advance_state(displacement)
       end
 
+      # Get n values following a probabilist distribution
+      # (uniform: min and max, exponential: rate, weibull: scale and shape)
+      def sample(distribution, params, n)
+        case distribution
+        when 'uniform'
+          min = params['min'].to_f
+          max = params['max'].to_f
+          return Array.new(n) { min + (max - min) * rand_U01 }
+        when 'exponential'
+          rate = params['rate'].to_f
+          return Array.new(n) { -Math::log(rand_U01) / rate }
+        when 'weibull'
+          scale = params['scale'].to_f
+          shape = params['shape'].to_f
+          return Array.new(n) { scale * ( (-Math::log(rand_U01)) ** (1.0 / shape) ) }
+        else
+          raise "Probabilist distribution not supported : #{distribution}"
+        end
+      end
+
+      # Get the next value following a probabilist distribution
+      def next_value(distribution, params)
+        return sample(distribution, params, 1)[0]
+      end
+
     end
   end
 end
@@ -1,6 +1,8 @@
 module Distem
   module Events
     class RngStreamRandomGenerator < RandomGenerator
+      # Number of values computed at once by next_value
+      BUFFER_SIZE = 256
 
       # Class which use a RngStream to generate random numbers
       # Better from a statistical point of view, because each stream
@@ -9,6 +11,8 @@ module Distem
 
       def initialize(seed = nil)
         @stream = RandomExtension::RngStream.new
+        @buffer = []
+        @buffer_key = nil
         if seed
           if seed.is_a?(Array)
             raise "Invalid seed array size, must be >= 6" if seed.length < 6
@@ -23,14 +27,42 @@ module Distem
       end
 
       def rand_U01
+        flush
         return @stream.randU01
       end
 
       def advance_state(displacement)
+        flush
         @stream.advance_state(displacement)
         return self
       end
 
+      # The values are computed by the C extension
+      def sample(distribution, params, n)
+        flush
+        return @stream.sample(distribution, params, n).unpack('d*')
+      end
+
+      # Values are computed BUFFER_SIZE at a time, the sequence is the same
+      # as if they were computed one by one
+      def next_value(distribution, params)
+        key = [distribution, params]
+        if @buffer.empty? or @buffer_key != key
+          @buffer = sample(distribution, params, BUFFER_SIZE)
+          @buffer_key = key
+        end
+        return @buffer.shift
+      end
+
+      protected
+
+      # Rewind the stream to the first value of the buffer that was not used
+      def flush
+        @stream.advance_state(-@buffer.size) unless @buffer.empty?
+        @buffer = []
+        @buffer_key = nil
+      end
+
     end
   end
 end
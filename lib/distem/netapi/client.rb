@@ -1,4 +1,5 @@
-require 'rest_client'
+require 'net/http'
+require 'uri'
 require 'json'
 require 'cgi'
 require 'pp'
@@ -25,6 +26,9 @@ module Distem
       # The HTTP OK status value
       # @private
       HTTP_STATUS_OK = 200
+      # The HTTP status of a body the server cannot decode
+      # @private
+      HTTP_STATUS_UNSUPPORTED_MEDIA_TYPE = 415
 
       @@semreq = Lib::Semaphore.new(MAX_SIMULTANEOUS_REQ)
 
@@ -37,7 +41,7 @@ module Distem
         raise unless port.is_a?(Numeric)
         @serveraddr = serveraddr
         @serverurl = 'http://' + @serveraddr + ':' + port.to_s
-        @resource = RestClient::Resource.new(@serverurl, :timeout => 9999, :open_timeout => 9999)
+        @pool = ConnectionPool.get(@serveraddr, port)
         @@semreq = Lib::Semaphore.new(semsize) if semsize and @@semreq.size != semsize
       end
 
@@ -171,7 +175,7 @@ module Distem
       # @param [Boolean] async Asynchronious mode, check virtual node status to know when node is configured (see {#vnode_info})
       # @return [Array] The virtual nodes description (see {file:files/resources_desc.md#Virtual_Nodes Resource Description - VNodes})
       def vnodes_create(names, desc = {}, ssh_key={}, async=false)
-        post_json('/vnodes', { :names => names , :desc => desc, :ssh_key => ssh_key, :async => async })
+        post_bulk('/vnodes', { :names => names , :desc => desc, :ssh_key => ssh_key, :async => async })
       end
 
       # Remove the virtual node
@@ -355,7 +359,19 @@ module Distem
       # @param [String] command The command to be executed
       # @return [Hash] The result of the command (one entry by vnode)
       def vnodes_execute(names, command)
-        post_json("/commands", { :names => names, :command => command })
+        post_bulk("/commands", { :names => names, :command => command })
+      end
+
+      # Execute a command on a set of virtual nodes, the output is received as it comes
+      #
+      # @param [Array] names Array of virtual nodes
+      # @param [String] command The command to be executed
+      # @param [Numeric] timeout The time (in seconds) after which the command is killed on a virtual node, nil for no limit
+      # @yield [Hash] Every chunk of output: { 'vnode' => name, 'stream' => 'out' or 'err', 'data' => String }, then for each virtual node { 'vnode' => name, 'stream' => 'exit', 'status' => exit code (nil if killed), 'timeout' => Boolean } ('error' => message instead of 'status' if the command could not be run)
+      def vnodes_execute_stream(names, command, timeout = nil, &block)
+        params = { 'names' => names, 'command' => command }
+        params['timeout'] = timeout if timeout
+        post_stream("/commands/stream", params, &block)
       end
 
       # Create a virtual network interface on the virtual node
@@ -542,6 +558,13 @@ module Distem
         put_json('/vnetworks', {:address => address, :netmask => netmask})
       end
 
+      # Create several virtual networks and their virtual routes on a PNode with a single request (Should not be called directly)
+      # @param [Array] vnetworks The descriptions of the virtual networks (name, address, opts and vroutes, an Array of Hash with the destnetwork and the gatewaynode)
+      # @return [Array] The virtual network descriptions
+      def vnetworks_sync(vnetworks)
+        post_bulk('/vnetworks/sync', { :vnetworks => vnetworks })
+      end
+
       # Remove a virtual network, that will disconnect every virtual node connected on it and remove it's virtual routes.
       #
       # @param [String] vnetname The name of the virtual network
@@ -595,7 +618,7 @@ module Distem
       # @param [String] rootfs The rootfs to boot vnodes
       # @return [Hash] The virtual platform description (see {file:files/resources_desc.md#Virtual_Platform Resource Description - VPlatform})
       def vplatform_create(data,format = 'JSON',rootfs = nil)
-        post_json("/vplatform", { 'format' => format, 'data' => data, 'rootfs' => rootfs })
+        post_bulk("/vplatform", { 'format' => format, 'data' => data, 'rootfs' => rootfs })
       end
 
       def run_alevin()
@@ -676,11 +699,24 @@ module Distem
       #
       # @param [Array] ordered vnode names
       # @param [Array] matrix of latencies
-      def set_peers_latencies(vnodes, matrix)
+      # @param [Array] matrix of bandwidths, set in the same call (see {#set_peers_bandwidths})
+      def set_peers_latencies(vnodes, matrix, bandwidths = nil)
+        params = {}
+        params['vnodes'] = vnodes
+        params['matrix'] = matrix
+        params['bandwidths'] = bandwidths if bandwidths
+        post_bulk("/peers_matrix_latencies", params)
+      end
+
+      # Configure bandwidths of peers from a matrix
+      #
+      # @param [Array] ordered vnode names
+      # @param [Array] matrix of bandwidths, rates at 'tc' form such as "10mbit" (0 or nil for none)
+      def set_peers_bandwidths(vnodes, matrix)
         params = {}
         params['vnodes'] = vnodes
         params['matrix'] = matrix
-        post_json("/peers_matrix_latencies", params)
+        post_bulk("/peers_matrix_bandwidths", params)
       end
 
       # Create a global /etc/hosts on every Vnodes
@@ -689,7 +725,7 @@ module Distem
       def set_global_etchosts(data = nil)
         params = {}
         params['data'] = data if data
-        post_json("/global_etchosts", params)
+        post_bulk("/global_etchosts", params)
       end
 
       # Create a new memory limitation
@@ -714,11 +750,27 @@ module Distem
       #
       # @param [Array] data The whole ip->mac information. Format is [[mac1,ip1],[mac2,ip2],...]
       # @param [String] arp_file Destination file
+      # @return [Hash] The number of entries set and the time it took (in seconds) for each vnode
       def set_global_arptable(data = nil, arp_file = nil)
         params = {}
         params['data'] = data if data
         params['arp_file'] = arp_file if arp_file
-        post_json("/global_arptable", params)
+        post_bulk("/global_arptable", params)
+      end
+
+      # Run a call on a pnode and relay it to a subtree of pnodes (Should not be called directly, see {Distem::Daemon::Broadcast})
+      # @param [String] method The name of the method
+      # @param [Array] args The arguments of the call
+      # @param [String] target The name of the pnode in targets
+      # @param [Hash] targets The pnodes of the subtree and their arguments
+      # @param [String] digest The digest of the content sent
+      # @param [Numeric] arity The arity of the tree
+      # @return [Hash] The result of the call on each pnode of the subtree
+      def broadcast(method, args, target, targets, digest = nil, arity = nil)
+        params = { 'method' => method, 'args' => args, 'target' => target, 'targets' => targets }
+        params['digest'] = digest if digest
+        params['arity'] = arity if arity
+        post_bulk('/broadcast', params)
       end
 
       # Wait a set of vnodes (or all) by checking that a given port (22 by default) is open. Should not be used directly after vnode_start! or vnodes_start!
@@ -729,57 +781,70 @@ module Distem
         return (post_json('/wait_vnodes', {'opts' => opts.to_json}) == ['true'])
       end
 
+      # Wait a set of vnodes (or all) by checking that a given port is open, each vnode is received as soon as its port opened, so that the work can start on it while the others are still booting
+      #
+      # @param [Hash] Options, see {#wait_vnodes}
+      # @yield [Hash] { 'vnode' => name, 'status' => 'ready' } for each vnode as soon as its port opened, then { 'vnode' => name, 'status' => 'timeout' } for each vnode whose port did not open ('error' with an 'error' message if its physical node failed)
+      def wait_vnodes_stream(opts = {}, &block)
+        post_stream('/wait_vnodes/stream', { 'opts' => opts }, &block)
+      end
+
+      # Retrieve the usage of the connections of the server to the other daemons (i.e. of the coordinator to the pnodes), and the latency of its requests
+      #
+      # @return [Hash] The statistics of each daemon ("address:port" => Hash, see {ConnectionPool#stats})
+      def connection_pools_info()
+        get_json("/connection_pools")
+      end
+
       protected
 
       # Check if there was an error in the REST request
       # @private
       # ==== Attributes
-      # * +result+ the result header (see RestClient)
-      # * +response+ the response header (see RestClient)
+      # * +response+ the response (Net::HTTPResponse)
       # ==== Returns
-      # The response header object if no problems found (String)
+      # The body of the response if no problems found (String)
       # ==== Exceptions
       # * +ClientError+ if the HTTP status returned performing the request is not HTTP_OK, the Exception object contains the description of the error
-      def check_error(result,response)
-        case result.code.to_i
+      def check_error(response)
+        body = response.body || ''
+        body.force_encoding(Encoding::UTF_8)
+        case response.code.to_i
           when HTTP_STATUS_OK
           else
             begin
-              body = JSON.parse(response)
+              body = JSON.parse(body)
             rescue JSON::ParserError
-              body = response
             end
             raise Lib::ClientError.new(
-              result.code.to_i,
-              response.headers[:x_application_error_code],
+              response.code.to_i,
+              response['X-Application-Error-Code'],
               body
             )
         end
-        return response
+        return body
       end
 
       # Check if there was an error related to the network connection
       # @private
       # ==== Attributes
       # * +route+ the route path to access (REST)
+      # * +limited+ count the request in MAX_SIMULTANEOUS_REQ (not the long streamed ones)
       # ==== Returns
       # ==== Exceptions
-      # * +InvalidParameterError+ if given path is not available on the server
       # * +UnavailableResourceError+ if for one reason or another the host is unreachable
-      def check_net(route)
-        @@semreq.synchronize {
-          begin
-            yield
-          rescue RestClient::RequestFailed => e
-            raise Lib::InvalidParameterError, "#{e.to_s} ... #{@serverurl}#{route}"
-          rescue RestClient::Exception, Errno::ECONNREFUSED, Timeout::Error, \
-            RestClient::RequestTimeout, Errno::ECONNRESET, SocketError
-            raise Lib::UnavailableResourceError, @serverurl
-          end
-        }
+      def check_net(route, limited = true)
+        return @@semreq.synchronize { check_net(route, false) { yield } } if limited
+        begin
+          yield
+        rescue Errno::ECONNREFUSED, Timeout::Error, Errno::ECONNRESET, \
+          Errno::EHOSTUNREACH, Errno::EPIPE, EOFError, SocketError, \
+          Net::HTTPBadResponse
+          raise Lib::UnavailableResourceError, @serverurl
+        end
       end
 
-      # Convert a Ruby structure to something that RestClient can digest
+      # Convert a Ruby structure to something that can be sent as form parameters
       # @param [Hash] h hash whose values will be flattened
       # @return new hash with its values converted to string or simple types
       def flatten_hash(h)
@@ -799,25 +864,83 @@ module Distem
       # @param [String] route route where the resource is located
       # @param [Hash] data optional content to post/put/delete/get
       # @param [Boolean] convert to json or not
+      # @param [Boolean] bulk send the data with Codec instead of form parameters
       # @return JSON or raw content
-      def raw_request(method, route, data = {}, json = true)
-        data = flatten_hash(data)
+      def raw_request(method, route, data = {}, json = true, bulk = false)
+        data = flatten_hash(data) unless bulk
         ret = json ? {} : ''
         check_net(route) do
-          @resource[route].send(method, data) { |response, request, result|
-            ret = check_error(result, response)
-            if json then
-              ret = (ret == "" || !ret.is_a?(String)) ? nil : JSON.parse(ret)
-            end
-          }
+          res = @pool.request(build_request(method, route, data, bulk))
+          if bulk && (res.code.to_i == HTTP_STATUS_UNSUPPORTED_MEDIA_TYPE) && @pool.msgpack
+            # the server does not decode MessagePack
+            @pool.msgpack = false
+            res = @pool.request(build_request(method, route, data, bulk))
+          end
+          ret = check_error(res)
+          if json then
+            ret = (ret == "") ? nil : Codec.decode(ret, res.content_type)
+          end
         end
         ret
       end
 
+      # Build the Net::HTTPRequest of raw_request
+      # @private
+      def build_request(method, route, data, bulk)
+        case method
+        when :post, :put
+          req = (method == :post ? Net::HTTP::Post : Net::HTTP::Put).new(route)
+          if bulk
+            type = @pool.msgpack ? Codec.type : Codec::JSON_TYPE
+            body, encoding = Codec.compress(Codec.encode(data, type))
+            req['Content-Type'] = type
+            req['Content-Encoding'] = encoding if encoding
+            req['Accept'] = [type, Codec::JSON_TYPE].uniq.join(', ')
+            req.body = body
+          else
+            req.set_form_data(data)
+          end
+        else
+          path = data.empty? ? route : "#{route}?#{URI.encode_www_form(data)}"
+          req = (method == :get ? Net::HTTP::Get : Net::HTTP::Delete).new(path)
+        end
+        return req
+      end
+
       def post_json(route, data)
         raw_request(:post, route, data)
       end
 
+      # Same as post_json for the bulk requests: the data is sent with Codec, keeping the types of its values
+      def post_bulk(route, data)
+        raw_request(:post, route, data, true, true)
+      end
+
+      # Send a bulk request whose response is streamed, each of its objects is yielded as soon as it is received. The request is small, it is always sent in JSON
+      def post_stream(route, data)
+        req = Net::HTTP::Post.new(route)
+        body, encoding = Codec.compress(Codec.encode(data, Codec::JSON_TYPE))
+        req['Content-Type'] = Codec::JSON_TYPE
+        req['Content-Encoding'] = encoding if encoding
+        req['Accept'] = Codec::NDJSON_TYPE
+        req.body = body
+        check_net(route, false) do
+          @pool.request(req) { |res|
+            check_error(res) unless res.code.to_i == HTTP_STATUS_OK
+            buf = ''
+            res.read_body { |part|
+              buf << part
+              while (i = buf.index("\n"))
+                obj = JSON.parse(buf.slice!(0, i + 1))
+                raise Lib::ResourceError, obj['error'] unless obj['vnode']
+                yield obj
+              end
+            }
+          }
+        end
+        return nil
+      end
+
       def put_json(route, data)
         raw_request(:put, route, data)
       end
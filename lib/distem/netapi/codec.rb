@@ -0,0 +1,76 @@
+require 'json'
+require 'zlib'
+
+module Distem
+  module NetAPI
+
+    # Encoding of the bodies of the bulk requests (see Client#post_bulk) and of their responses. The parameters are sent as a single structure (MessagePack when the msgpack gem is installed, JSON otherwise) instead of form parameters holding JSON strings, and the bodies are compressed with deflate above COMPRESS_MIN bytes. The encoding is negotiated with the Content-Type/Accept and Content-Encoding headers, a server that cannot decode MessagePack answers 415 and gets JSON
+    module Codec
+      JSON_TYPE = 'application/json'
+      MSGPACK_TYPE = 'application/x-msgpack'
+      # The streamed responses, a JSON object per line
+      NDJSON_TYPE = 'application/x-ndjson'
+      DEFLATE = 'deflate'
+      # The smaller bodies are not compressed
+      COMPRESS_MIN = 1024
+
+      begin
+        require 'msgpack'
+        MSGPACK = true
+      rescue LoadError
+        MSGPACK = false
+      end
+
+      # The media type to encode with (the binary one if available)
+      def self.type
+        return (MSGPACK ? MSGPACK_TYPE : JSON_TYPE)
+      end
+
+      # Whether the media type is one of the Codec
+      def self.type?(type)
+        return [JSON_TYPE, MSGPACK_TYPE].include?(type)
+      end
+
+      # Whether the bodies of this media type can be decoded
+      def self.supported?(type)
+        return (type == JSON_TYPE) || (MSGPACK && (type == MSGPACK_TYPE))
+      end
+
+      # Whether the media type is listed in the Accept header
+      def self.accepted?(accept, type)
+        return accept.to_s.split(',').any? { |t| t.split(';').first.strip == type }
+      end
+
+      def self.encode(obj, type)
+        return (type == MSGPACK_TYPE ? MessagePack.pack(obj) : JSON.generate(obj))
+      end
+
+      def self.decode(str, type)
+        return (type == MSGPACK_TYPE ? MessagePack.unpack(str) : JSON.parse(str))
+      end
+
+      # An object of a streamed response
+      def self.line(obj)
+        return JSON.generate(obj) + "\n"
+      end
+
+      # Compress the body if it is large enough, returns the body and its Content-Encoding (nil if not compressed)
+      def self.compress(str)
+        return str, nil if str.bytesize < COMPRESS_MIN
+        return Zlib::Deflate.deflate(str, Zlib::BEST_SPEED), DEFLATE
+      end
+
+      def self.decompress(str, encoding)
+        case encoding
+        when nil, '', 'identity'
+          return str
+        when DEFLATE
+          return Zlib::Inflate.inflate(str)
+        else
+          raise Lib::InvalidParameterError, "Content-Encoding #{encoding}"
+        end
+      end
+    end
+
+  end
+end
@@ -0,0 +1,158 @@
+require 'net/http'
+require 'thread'
+
+module Distem
+  module NetAPI
+
+    # Persistent (HTTP/1.1 keep-alive) connections to the REST servers, shared by every Client of the process. A server gets at most +size+ connections, the requests beyond wait for a connection to be released. The pool also keeps the usage and the latency of the requests of each server (see #stats)
+    class ConnectionPool
+      # The default maximum number of connections to a server
+      SIZE = 32
+      # The connections idle for longer are closed instead of being reused (Puma closes them after 20s, WEBrick after 30s)
+      IDLE_TIMEOUT = 15
+      # The timeouts (in seconds) to open a connection and to read a response
+      OPEN_TIMEOUT = 9999
+      READ_TIMEOUT = 9999
+
+      @@pools = {}
+      @@lock = Mutex.new
+
+      # The pool of the connections to a server
+      def self.get(host, port)
+        @@lock.synchronize {
+          @@pools["#{host}:#{port}"] ||= ConnectionPool.new(host, port)
+        }
+      end
+
+      # The statistics of the pools of every server (Hash, "host:port" => Hash, see #stats)
+      def self.stats
+        pools = @@lock.synchronize { @@pools.dup }
+        ret = {}
+        pools.each_pair { |server,pool| ret[server] = pool.stats }
+        return ret
+      end
+
+      # Close the idle connections of every pool
+      def self.close_all
+        @@lock.synchronize { @@pools.values }.each { |pool| pool.close }
+      end
+
+      attr_reader :host, :port, :size
+      # Whether the bulk requests to the server are encoded with MessagePack (see Codec), cleared when the server cannot decode it
+      attr_accessor :msgpack
+
+      def initialize(host, port, size=SIZE)
+        @host = host
+        @port = port
+        @size = size
+        @msgpack = Codec::MSGPACK
+        @idle = []
+        @used = 0
+        @lock = Mutex.new
+        @released = ConditionVariable.new
+        @stats = {
+          :requests => 0,
+          :errors => 0,
+          :opened => 0,
+          :reused => 0,
+          :waits => 0,
+          :in_use_max => 0,
+          :latency_total => 0.0,
+          :latency_max => 0.0,
+        }
+      end
+
+      # Send the request (Net::HTTPRequest) on a connection of the pool and return the Net::HTTPResponse. Net::HTTP sends an idempotent request again if the server had closed the connection. If a block is given, the response is yielded before its body is read (see Net::HTTPResponse#read_body)
+      def request(req, &block)
+        start = Time.now
+        http = acquire
+        begin
+          res = http.request(req, &block)
+        rescue Exception
+          close_http(http)
+          http = nil
+          raise
+        ensure
+          release(http, Time.now - start)
+        end
+        return res
+      end
+
+      # Close the idle connections
+      def close
+        idle = @lock.synchronize {
+          ret = @idle
+          @idle = []
+          ret
+        }
+        idle.each { |http,_| close_http(http) }
+      end
+
+      # The usage of the pool: the number of connections in use and idle, then since the creation of the pool, the number of requests (and failed ones), of connections opened, of requests sent on a reused connection, of requests that waited for a connection, the maximum number of connections in use and the total and maximal latencies of the requests (in seconds)
+      def stats
+        @lock.synchronize {
+          @stats.merge(:in_use => @used, :idle => @idle.size)
+        }
+      end
+
+      protected
+
+      # Take an idle connection (or open a new one)
+      def acquire
+        http = nil
+        @lock.synchronize {
+          if @used >= @size
+            @stats[:waits] += 1
+            @released.wait(@lock) while @used >= @size
+          end
+          @used += 1
+          @stats[:in_use_max] = @used if @used > @stats[:in_use_max]
+          now = Time.now
+          while (idle = @idle.pop)
+            if (now - idle[1]) < IDLE_TIMEOUT
+              http = idle[0]
+              break
+            end
+            close_http(idle[0])
+          end
+          @stats[http ? :reused : :opened] += 1
+        }
+        return http if http
+        begin
+          return connect
+        rescue Exception
+          release(nil, 0.0, true)
+          raise
+        end
+      end
+
+      # Give back a connection (nil if it was closed on an error) and account the request
+      def release(http, latency, failed=http.nil?)
+        @lock.synchronize {
+          @used -= 1
+          @idle << [http, Time.now] if http
+          @stats[:requests] += 1
+          @stats[:errors] += 1 if failed
+          @stats[:latency_total] += latency
+          @stats[:latency_max] = latency if latency > @stats[:latency_max]
+          @released.signal
+        }
+      end
+
+      def connect
+        http = Net::HTTP.new(@host, @port)
+        http.open_timeout = OPEN_TIMEOUT
+        http.read_timeout = READ_TIMEOUT
+        http.keep_alive_timeout = IDLE_TIMEOUT
+        http.start
+        return http
+      end
+
+      def close_http(http)
+        http.finish if http.started?
+      rescue IOError, SystemCallError
+      end
+    end
+
+  end
+end
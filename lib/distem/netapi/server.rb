@@ -3,13 +3,17 @@ require 'socket'
 require 'ipaddress'
 require 'json'
 require 'cgi'
-require 'webrick'
+begin
+  require 'puma'
+rescue LoadError
+  require 'webrick'
 
-# @private
-module WEBrick
   # @private
-  module Config
-    General[:MaxClients] = 2048
+  module WEBrick
+    # @private
+    module Config
+      General[:MaxClients] = 2048
+    end
   end
 end
 
@@ -37,14 +41,23 @@ module Distem
       HTTP_STATUS_NOT_FOUND = 404 # @private
       HTTP_STATUS_BAD_REQUEST = 400 # @private
       HTTP_STATUS_INTERN_SERV_ERROR = 500 # @private
+      HTTP_STATUS_UNSUPPORTED_MEDIA_TYPE = 415 # @private
       HTTP_STATUS_NOT_IMPLEMENTED = 501 # @private
+      # The bounds of the pool of threads that handle the requests with Puma. The idle keep-alive connections are left to its reactor, a thread is only held during a request (i.e. a long async=false one)
+      THREADS = '8:256' # @private
 
       set :environment, :development
       set :show_exceptions, false
       set :raise_errors, true
       set :run, true
       set :bind, '0.0.0.0'
-      set :server, 'webrick'
+      # Puma if it is installed (a reactor and a pool of threads), WEBrick (a thread per connection) otherwise. The daemon keeps its state in memory so a single process serves the requests
+      set :server, ['puma', 'webrick']
+      set :server_settings, { :Threads => THREADS }
+      # Compress the large responses for the clients that accept it (Net::HTTP does)
+      use Rack::Deflater, :if => lambda { |env, status, headers, body|
+        body.is_a?(Array) && (body.inject(0) { |size,part| size + part.bytesize } >= Codec::COMPRESS_MIN)
+      }
 
       # @private
       def initialize()
@@ -67,6 +80,20 @@ module Distem
         content_type 'application/json', :charset => 'utf-8'
       end
 
+      # Set the parameters of the bulk requests, sent with Codec (see Client#post_bulk)
+      # @private
+      before do
+        if Codec.type?(request.media_type)
+          halt HTTP_STATUS_UNSUPPORTED_MEDIA_TYPE unless Codec.supported?(request.media_type)
+          begin
+            body = Codec.decompress(request.body.read, request.env['HTTP_CONTENT_ENCODING'])
+            params.merge!(Codec.decode(body, request.media_type))
+          rescue StandardError, Lib::ParameterError => e
+            halt HTTP_STATUS_BAD_REQUEST, { HTTP_HEADER_ERR => get_http_err_desc(e) }, ''
+          end
+        end
+      end
+
       # Return server resource error
       # @private
       not_found do
@@ -118,7 +145,7 @@ module Distem
       # * *desc* -- JSON Hash structured as follows: { 'probe1_type' => { 'name' => probe1_name, 'frequency' => freq, ...}}}
       post '/pnodes/probes' do
         check do
-          desc = JSON.parse(params['desc'])
+          desc = parse_param(params['desc'])
           ref_time = params.has_key?('ref_time') ? params['ref_time'] : nil
           @daemon.pnodes_launch_probes(desc, ref_time)
           @body = ""
@@ -163,8 +190,8 @@ module Distem
       post '/pnodes/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
-          target = (params['target'] == "" or params['target'].nil?) ? nil : JSON.parse(params['target'])
+          desc = parse_param(params['desc']) if params['desc']
+          target = (params['target'] == "" or params['target'].nil?) ? nil : parse_param(params['target'])
           @body = @daemon.pnode_create(target,desc,params['async'])
         end
         return result!
@@ -186,7 +213,7 @@ module Distem
       put '/pnodes/:pnode/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.pnode_update(params['pnode'],desc)
         end
 
@@ -253,8 +280,8 @@ module Distem
         check do
           desc = {}
           ssh_key = {}
-          desc = JSON.parse(params['desc']) if params['desc']
-          ssh_key = JSON.parse(params['ssh_key']) if params['ssh_key']
+          desc = parse_param(params['desc']) if params['desc']
+          ssh_key = parse_param(params['ssh_key']) if params['ssh_key']
           @body = @daemon.vnode_create(CGI.unescape(params['vnodename']), desc, ssh_key, params['async']).first
         end
 
@@ -272,9 +299,9 @@ module Distem
         check do
           desc = {}
           ssh_key = {}
-          desc = JSON.parse(params['desc']) if params['desc']
-          ssh_key = JSON.parse(params['ssh_key']) if params['ssh_key']
-          @body = @daemon.vnode_create(JSON.parse(params['names']), desc, ssh_key, params['async'])
+          desc = parse_param(params['desc']) if params['desc']
+          ssh_key = parse_param(params['ssh_key']) if params['ssh_key']
+          @body = @daemon.vnode_create(parse_param(params['names']), desc, ssh_key, params['async'])
         end
 
         return result!
@@ -307,7 +334,7 @@ module Distem
       put '/vnodes/:vnodename/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           case params['type']
           when 'update'
             @body = @daemon.vnode_update(CGI.unescape(params['vnodename']),desc,params['async']).first
@@ -335,8 +362,8 @@ module Distem
       # * *async* -- Asynchronious mode, check the physical node status to know when the configuration is done (see GET /vnodes/:vnodename)
       put '/vnodes/?' do
         check do
-          desc = params['desc'] ? JSON.parse(params['desc']) : {}
-          names = params['names'] ? JSON.parse(params['names']) : nil
+          desc = params['desc'] ? parse_param(params['desc']) : {}
+          names = params['names'] ? parse_param(params['names']) : nil
           case params['type']
           when 'update'
             @body = @daemon.vnode_update(names,desc,params['async'])
@@ -363,7 +390,7 @@ module Distem
       post '/vnodes/:vnodename/filesystem/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.vfilesystem_create(CGI.unescape(params['vnodename']),desc)
         end
 
@@ -377,7 +404,7 @@ module Distem
       put '/vnodes/:vnodename/filesystem/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.vfilesystem_update(CGI.unescape(params['vnodename']),desc)
         end
 
@@ -426,12 +453,39 @@ module Distem
       # * *command* -- The command to be executed
       post '/commands/?' do
         check do
-          @body = @daemon.vnodes_execute(JSON.parse(params['names']), params['command'])
+          @body = @daemon.vnodes_execute(parse_param(params['names']), params['command'])
         end
 
         return result!
       end
 
+      # Execute a command on a set of virtual nodes, the output is sent as it comes (chunked, one JSON object per line, see Client#vnodes_execute_stream)
+      #
+      # ==== Query parameters:
+      # * *names* -- Array of virtual nodes
+      # * *command* -- The command to be executed
+      # * *timeout* -- The time (in seconds) after which the command is killed on a virtual node
+      post '/commands/stream/?' do
+        names = nil
+        check do
+          names = parse_param(params['names'])
+          names = [names] unless names.is_a?(Array)
+          names.each { |name| @daemon.vnode_get(name) }
+        end
+        return result! unless @status == HTTP_STATUS_OK
+
+        content_type Codec::NDJSON_TYPE
+        stream do |out|
+          begin
+            @daemon.vnodes_execute_stream(names, params['command'], params['timeout'] && params['timeout'].to_f) { |chunk|
+              out << Codec.line(chunk)
+            }
+          rescue Lib::DistemError, StandardError => e
+            out << Codec.line('error' => e.to_s)
+          end
+        end
+      end
+
       # Create a new virtual interface on the targeted virtual node
       # The IP address is auto assigned to the virtual interface if not specified
       #
@@ -441,7 +495,7 @@ module Distem
       post '/vnodes/:vnodename/ifaces/?' do
         check do
           desc = {}
-            desc = JSON.parse(params['desc']) if params['desc']
+            desc = parse_param(params['desc']) if params['desc']
             @body = @daemon.viface_create(CGI.unescape(params['vnodename']),params['name'],desc)
         end
 
@@ -481,7 +535,7 @@ module Distem
           vnodename = CGI.unescape(params['vnodename'])
           vifacename = CGI.unescape(params['ifacename'])
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.viface_update(vnodename,vifacename,desc)
         end
 
@@ -511,7 +565,7 @@ module Distem
           vnodename = CGI.unescape(params['vnodename'])
           vifacename = CGI.unescape(params['ifacename'])
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.vinput_update(vnodename,vifacename,desc)
         end
 
@@ -541,7 +595,7 @@ module Distem
           vnodename = CGI.unescape(params['vnodename'])
           vifacename = CGI.unescape(params['ifacename'])
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.voutput_update(vnodename,vifacename,desc)
         end
 
@@ -556,7 +610,7 @@ module Distem
       post '/vnodes/:vnodename/cpu/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.vcpu_create(CGI.unescape(params['vnodename']),desc)
         end
 
@@ -581,7 +635,7 @@ module Distem
       put '/vnodes/:vnodename/cpu/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.vcpu_update(CGI.unescape(params['vnodename']),desc)
         end
 
@@ -605,7 +659,7 @@ module Distem
       #
       post '/vnetworks/?' do
         check do
-          opts = params.has_key?('opts') ? JSON.parse(params['opts']) : nil
+          opts = params.has_key?('opts') ? parse_param(params['opts']) : nil
           @body = @daemon.vnetwork_create(params['name'],params['address'],opts)
         end
 
@@ -625,6 +679,18 @@ module Distem
         return result!
       end
 
+      # Create several virtual networks and their virtual routes at once (used by the coordinator to set up the pnodes)
+      #
+      # ==== Query parameters
+      # * *vnetworks* -- JSON Array of the descriptions of the virtual networks (name, address, opts and vroutes)
+      post '/vnetworks/sync/?' do
+        check do
+          @body = @daemon.vnetworks_sync(parse_param(params['vnetworks']))
+        end
+
+        return result!
+      end
+
       # Delete the virtual network
       delete '/vnetworks/:vnetname/?' do
         check do
@@ -740,9 +806,9 @@ module Distem
       post '/events/trace/?' do
         check do
           trace = {}
-          trace = JSON.parse(params['trace']) if params['trace']
+          trace = parse_param(params['trace']) if params['trace']
           resource_desc = {}
-          resource_desc = JSON.parse(params['resource']) if params['resource']
+          resource_desc = parse_param(params['resource']) if params['resource']
           event_type = CGI.unescape(params['event_type'])
           @daemon.event_trace_add(resource_desc, event_type, trace)
           @body = ""
@@ -753,7 +819,7 @@ module Distem
       post '/events/trace_string/?' do
         check do
           trace_string = CGI.unescape(params['trace_string'])
-          resource_desc = JSON.parse(params['resource']) if params['resource']
+          resource_desc = parse_param(params['resource']) if params['resource']
           event_type = CGI.unescape(params['event_type'])
           @daemon.event_trace_string_add(resource_desc, event_type, trace_string)
           @body = ""
@@ -764,9 +830,9 @@ module Distem
       post '/events/random/?' do
         check do
           generator_desc = {}
-          generator_desc = JSON.parse(params['generator']) if params['generator']
+          generator_desc = parse_param(params['generator']) if params['generator']
           resource_desc = {}
-          resource_desc = JSON.parse(params['resource']) if params['resource']
+          resource_desc = parse_param(params['resource']) if params['resource']
           event_type = CGI.unescape(params['event_type'])
           first_value = nil
           first_value = CGI.unescape(params['first_value']) if params['first_value']
@@ -795,8 +861,16 @@ module Distem
 
       post '/peers_matrix_latencies/?' do
         check do
-          vnodes = (params['vnodes'] == "") ? nil : JSON.parse(params['vnodes'])
-          @body = @daemon.set_peers_latencies(vnodes, JSON.parse(params['matrix']))
+          vnodes = (params['vnodes'] == "") ? nil : parse_param(params['vnodes'])
+          bandwidths = params.has_key?('bandwidths') ? parse_param(params['bandwidths']) : nil
+          @body = @daemon.set_peers_latencies(vnodes, parse_param(params['matrix']), bandwidths)
+        end
+      end
+
+      post '/peers_matrix_bandwidths/?' do
+        check do
+          vnodes = (params['vnodes'] == "") ? nil : parse_param(params['vnodes'])
+          @body = @daemon.set_peers_bandwidths(vnodes, parse_param(params['matrix']))
         end
       end
 
@@ -811,7 +885,7 @@ module Distem
       post '/vnodes/:vnodename/vmem/?' do
         check do
           desc = {}
-          desc = JSON.parse(params['desc']) if params['desc']
+          desc = parse_param(params['desc']) if params['desc']
           @body = @daemon.vmem_create(params['vnodename'], desc)
         end
 
@@ -820,7 +894,7 @@ module Distem
 
       put '/vnodes/:vnodename/vmem/?' do
         check do
-          desc = params['desc'] ? JSON.parse(params['desc']) : {}
+          desc = params['desc'] ? parse_param(params['desc']) : {}
           @body = @daemon.vmem_update(params['vnodename'], desc)
         end
       end
@@ -829,19 +903,60 @@ module Distem
         check do
           data = params.has_key?('data') ? params['data'] : nil
           arp_file = params.has_key?('arp_file') ? params['arp_file'] : nil
-          @daemon.set_global_arptable(data, arp_file)
-          @body = ""
+          @body = @daemon.set_global_arptable(data, arp_file)
         end
+
+        return result!
+      end
+
+      # Run a call and relay it along a tree of pnodes (see Daemon::Broadcast)
+      post '/broadcast/?' do
+        check do
+          @body = @daemon.broadcast(
+            params['method'],
+            parse_param(params['args']),
+            params['target'],
+            parse_param(params['targets']),
+            params['digest'],
+            params['arity'] || Daemon::Broadcast::ARITY
+          )
+        end
+
+        return result!
       end
 
       post '/wait_vnodes/?' do
         check do
-          opts = params.has_key?('opts') ? JSON.parse(params['opts']) : {}
+          opts = params.has_key?('opts') ? parse_param(params['opts']) : {}
           @body = @daemon.wait_vnodes(opts)
         end
         return result!
       end
 
+      # Wait for a port to open on the virtual nodes, each virtual node is sent as soon as its port opened (chunked, one JSON object per line, see Client#wait_vnodes_stream)
+      #
+      # ==== Query parameters:
+      # * *opts* -- Hash, 'port', 'timeout' and 'vnodes' (see Client#wait_vnodes)
+      post '/wait_vnodes/stream/?' do
+        opts = nil
+        check do
+          opts = params.has_key?('opts') ? parse_param(params['opts']) : {}
+          opts = {} unless opts
+          vnodes = opts['vnodes']
+          (vnodes.is_a?(Array) ? vnodes : [vnodes]).compact.each { |name| @daemon.vnode_get(name) }
+        end
+        return result! unless @status == HTTP_STATUS_OK
+
+        content_type Codec::NDJSON_TYPE
+        stream do |out|
+          begin
+            @daemon.wait_vnodes_stream(opts) { |event| out << Codec.line(event) }
+          rescue Lib::DistemError, StandardError => e
+            out << Codec.line('error' => e.to_s)
+          end
+        end
+      end
+
       post '/vplatform/alevin/?' do
         check do
           @body = @daemon.run_alevin()
@@ -859,8 +974,22 @@ module Distem
         return result!
       end
 
+      # Get the usage and the latency of the connections of this daemon to the other ones (see ConnectionPool#stats)
+      get '/connection_pools/?' do
+        check do
+          @body = JSON.pretty_generate(ConnectionPool.stats)
+        end
+
+        return result!
+      end
+
       protected
 
+      # The value of a parameter holding a structure: JSON in the form parameters, already decoded in the bulk requests (see Codec)
+      def parse_param(value)
+        return (value.is_a?(String) ? JSON.parse(value) : value)
+      end
+
       # Setting up result (auto generate JSON if @body is a {Distem::Resource})
       # @return [Array] An array of the format [@status,@headers,@body]
       # @private
@@ -871,7 +1000,11 @@ module Distem
           or @body.is_a?(Array) or @body.is_a?(Hash)
           @body = TopologyStore::HashWriter.new.visit(@body)
         end
-        if @body.is_a?(Array) or @body.is_a?(Hash)
+        if (@body.is_a?(Array) or @body.is_a?(Hash)) and Codec::MSGPACK \
+          and Codec.accepted?(request.env['HTTP_ACCEPT'], Codec::MSGPACK_TYPE)
+          content_type Codec::MSGPACK_TYPE
+          @body = Codec.encode(@body, Codec::MSGPACK_TYPE)
+        elsif @body.is_a?(Array) or @body.is_a?(Hash)
           tmpbody = @body
           begin
             @body = JSON.pretty_generate(@body)
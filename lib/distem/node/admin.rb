@@ -16,6 +16,8 @@ module Distem
 
       # The maximal number of virtual network interfaces that can be created on this machine
       @@vifaces_max=MAX_VIFACES
+      # Is the output traffic of the virtual network interfaces shaped on ifb devices (otherwise, inside the network namespace of the vnodes)
+      @@ifb=true
 
       #The path to cgroup1 for this pnode (i.e /sys/fs/cgroup)
       @cgroup1_path=nil
@@ -25,13 +27,18 @@ module Distem
       # Initialize a physical node (set cgroups, bridge, ifb, fill the PNode cpu and memory informations, ...)
       # ==== Attributes
       # * +pnode+ The PNode object that will be filled with different informations
-      # * +properties+ An hash containing specific initialization parameters (max_vifaces,)
+      # * +properties+ An hash containing specific initialization parameters (max_vifaces,set_bridge,ifb). Without ifb devices (ifb set to false), the number of virtual network interfaces is only limited by max_vifaces
       #
       def self.init_node(pnode,properties)
-        @@vifaces_max = properties['max_vifaces'].to_i if properties['max_vifaces']
+        @@ifb = !['false','no','0'].include?(properties['ifb'].to_s) unless properties['ifb'].nil?
+        if properties['max_vifaces']
+          @@vifaces_max = properties['max_vifaces'].to_i
+        elsif !@@ifb
+          @@vifaces_max = Float::INFINITY
+        end
         set_cgroups()
         set_pty()
-        Lib::NetTools.set_resource(@@vifaces_max,properties['set_bridge'])
+        Lib::NetTools.set_resource(@@vifaces_max,properties['set_bridge'],@@ifb)
         Lib::CPUTools.set_resource(pnode.cpu)
         Lib::MemoryTools.set_resource(pnode.memory)
         Lib::FileSystemTools.set_resource()
@@ -46,9 +53,33 @@ module Distem
         return @@vifaces_max
       end
 
+      # Is the output traffic of the virtual network interfaces shaped on ifb devices
+      # ==== Returns
+      # Boolean value
+      #
+      def self.ifb?()
+        return @@ifb
+      end
+
+      # Get the path to the root of the cgroup1 hierarchies of this physical node
+      # ==== Returns
+      # String object
+      #
+      def self.cgroup1_path()
+        return @cgroup1_path
+      end
+
+      # Get the path to the cgroup2 hierarchy of this physical node
+      # ==== Returns
+      # String object or nil if the unified hierarchy is not mounted
+      #
+      def self.cgroup2_path()
+        return @cgroup2_path
+      end
+
       # Clean and unset all content set by the system (remove cgroups, bridge, ifb, temporary files, ...)
       def self.quit_node()
-        Lib::NetTools.unset_ifb()
+        Lib::NetTools.unset_ifb() if @@ifb
         unset_cgroups()
         Lib::Shell.run("rm -R #{PATH_DISTEMTMP}") if File.exist?(PATH_DISTEMTMP)
       end
@@ -51,7 +51,7 @@ module Distem
         @cpuforge = CPUForge.new(@vnode,@vnode.host.algorithms[:cpu])
         @networkforges = {}
         @vnode.vifaces.each do |viface|
-          @networkforges[viface] = NetworkForge.new(viface)
+          @networkforges[viface] = NetworkForge.new(viface,@vnode.host.algorithms[:network])
         end
         @curname = ""
         @configfile = ""
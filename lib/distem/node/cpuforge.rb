@@ -18,6 +18,8 @@ module Distem
             algorithm = Algorithm::CPU::Gov.new
           when Algorithm::CPU::HOGS.upcase
             algorithm = Algorithm::CPU::Hogs.new
+          when Algorithm::CPU::QUOTA.upcase
+            algorithm = Algorithm::CPU::Quota.new
           else
             algorithm = Algorithm::CPU::Hogs.new
         end
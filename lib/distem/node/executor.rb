@@ -0,0 +1,139 @@
+require 'thread'
+
+module Distem
+  module Node
+
+    # Execution of a command in a set of containers. The command is run by lxc-attach, in the namespaces and the cgroups of the container (without going through its network and its ssh server), and the pipes of every command are read by a single thread as their output comes. At most +window+ commands run at the same time, a command still running after +timeout+ seconds is killed
+    class Executor
+      # The default maximum number of commands running at the same time
+      WINDOW = 100
+      # The size of the reads on the pipes
+      CHUNK_SIZE = 16384
+      # The time given to a command to exit after SIGTERM, it is then killed with SIGKILL
+      KILL_DELAY = 2
+      # The maximal time between two checks of the timeouts and of the exit of the commands
+      POLL_INTERVAL = 0.1
+
+      # A running command
+      Job = Struct.new(:name, :pid, :pipes, :start, :killed, :timeout) # :nodoc:
+
+      # ==== Attributes
+      # * +window+ The maximum number of commands running at the same time
+      # * +timeout+ The time (in seconds) after which a command is killed, nil for no limit
+      def initialize(window = WINDOW, timeout = nil)
+        @window = window
+        @timeout = timeout
+      end
+
+      # Run the command in every container
+      # ==== Attributes
+      # * +names+ The names of the containers
+      # * +command+ The command, run by /bin/sh -c
+      # ==== Yields
+      # Every chunk of output as soon as it is read: { 'vnode' => name, 'stream' => 'out' or 'err', 'data' => String }, then when the command ended in a container: { 'vnode' => name, 'stream' => 'exit', 'status' => exit code (nil if killed by a signal), 'timeout' => whether it was killed after the timeout } (with 'error' => message instead of 'status' if it could not be run)
+      def run(names, command)
+        queue = names.dup
+        jobs = []
+        until queue.empty? && jobs.empty?
+          while !queue.empty? && jobs.size < @window
+            name = queue.shift
+            begin
+              jobs << spawn(name, command)
+            rescue SystemCallError => e
+              yield({ 'vnode' => name, 'stream' => 'exit', 'error' => e.to_s })
+            end
+          end
+
+          now = Time.now
+          jobs.each { |job| check_timeout(job, now) }
+          pipes = {}
+          jobs.each { |job| job.pipes.each_key { |io| pipes[io] = job } }
+          ready, = IO.select(pipes.keys, nil, nil, POLL_INTERVAL) unless pipes.empty?
+          if ready
+            ready.each { |io| read(pipes[io], io) { |chunk| yield chunk } }
+          elsif pipes.empty?
+            sleep(POLL_INTERVAL)
+          end
+
+          jobs.delete_if { |job|
+            next false unless job.pipes.empty?
+            pid, status = Process.wait2(job.pid, Process::WNOHANG)
+            next false unless pid
+            yield({ 'vnode' => job.name, 'stream' => 'exit', 'status' => status.exitstatus, 'timeout' => job.timeout })
+            true
+          }
+        end
+      ensure
+        # the block raised (i.e. the client went away)
+        (jobs || []).each { |job|
+          kill(job, 'KILL')
+          job.pipes.each_key { |io| io.close }
+          Process.detach(job.pid)
+        }
+      end
+
+      protected
+
+      def spawn(name, command)
+        rout, wout = IO.pipe
+        rerr, werr = IO.pipe
+        begin
+          pid = Process.spawn(*LXCWrapper::Command.attach_cmd(name, command),
+            :in => '/dev/null', :out => wout, :err => werr, :pgroup => true)
+        rescue SystemCallError
+          [rout, rerr].each { |io| io.close }
+          raise
+        ensure
+          [wout, werr].each { |io| io.close }
+        end
+        return Job.new(name, pid, { rout => ['out', ''.b], rerr => ['err', ''.b] }, Time.now, nil, false)
+      end
+
+      # Read a chunk of output, the pipe is closed at its end
+      def read(job, io)
+        stream, pending = job.pipes[io]
+        data = io.read_nonblock(CHUNK_SIZE, :exception => false)
+        return if data == :wait_readable
+        if data
+          data, job.pipes[io][1] = split_utf8(pending + data)
+        else
+          io.close
+          job.pipes.delete(io)
+          data = pending
+        end
+        yield({ 'vnode' => job.name, 'stream' => stream, 'data' => data.force_encoding(Encoding::UTF_8).scrub }) unless data.empty?
+      end
+
+      # Split the bytes of a character cut at the end of a chunk, they are sent with the next one
+      def split_utf8(data)
+        unless data.dup.force_encoding(Encoding::UTF_8).valid_encoding?
+          (1..[3, data.bytesize].min).each { |n|
+            head = data.byteslice(0, data.bytesize - n)
+            return head, data.byteslice(-n, n) if head.dup.force_encoding(Encoding::UTF_8).valid_encoding?
+          }
+        end
+        return data, ''.b
+      end
+
+      # Kill the command after the timeout (with SIGTERM, then SIGKILL), the output of a command killed with SIGKILL is no longer read
+      def check_timeout(job, now)
+        if job.killed
+          return if (now - job.killed) < KILL_DELAY
+          kill(job, 'KILL')
+          job.pipes.each_key { |io| io.close }
+          job.pipes.clear
+        elsif @timeout && (now - job.start) >= @timeout
+          kill(job, 'TERM')
+          job.killed = now
+          job.timeout = true
+        end
+      end
+
+      def kill(job, signal)
+        Process.kill(signal, -job.pid)
+      rescue SystemCallError
+      end
+    end
+
+  end
+end
@@ -9,7 +9,7 @@ module Distem
       # Initialize the allocator. Will automatically guess the number of ifb devices.
       def initialize
         @allocmutex = Mutex::new
-        @ifbs = Lib::Shell.run('ip link list').scan(/: (ifb\d+):/).map { |e| e[0] }
+        @ifbs = Lib::NetTools.rtnetlink { |nl| nl.links }.collect { |link| link['name'] }.grep(/\Aifb\d+\z/)
       end
 
       # Get an IFB device name (e.g. "ifb42")
@@ -20,7 +20,7 @@ module Distem
           ifb = @ifbs.shift
         @allocmutex.unlock
         # make sure the IFB device is up
-        Lib::Shell.run("ip link set dev #{ifb} up")
+        Lib::NetTools.rtnetlink { |nl| nl.link_set(ifb, 'up' => true) }
         return ifb
       end
 
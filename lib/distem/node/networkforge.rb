@@ -8,9 +8,18 @@ module Distem
       # Create a new NetworkForge specifying the virtual network interface resource to modify (limit) and the algorithm to use
       # ==== Attributes
       # * +viface+ The VIface object
-      # * +algorithm+ The Algorithm::Network object
+      # * +algorithm+ The name of the Algorithm::Network to use
       #
-      def initialize(viface,algorithm=Algorithm::Network::TBF.new)
+      def initialize(viface,algorithm=Algorithm::Network::TC)
+        case algorithm.to_s.upcase
+          when Algorithm::Network::BPF.upcase
+            algorithm = Algorithm::Network::EBPF.new
+          when Algorithm::Network::HTB.upcase
+            algorithm = Algorithm::Network::HTBNetem.new
+          else
+            algorithm = Algorithm::Network::TBF.new
+        end
+
         super(viface,algorithm)
       end
     end
@@ -35,6 +35,8 @@ module Distem
             when 'mbps' then (1024**2) # megabytes
             when 'kbit' then (1024 / 8) # kilobits
             when 'mbit' then (1024**2 / 8) # megabits
+            when 'gbps' then (1024**3) # gigabytes
+            when 'gbit' then (1024**3 / 8) # gigabits
             when 'bps', '' then 1   # bytes
             else nil
           end
@@ -42,6 +44,30 @@ module Distem
           return (digits.to_i * mult)
         end
 
+        # converts rate to integer number of bytes per second with the units of
+        # 'tc' (decimal, 1mbit is 10^6 bits, a rate without unit is in bits, the
+        # case of the unit is ignored)
+        # raises ArgumentError if the rate cannot be parsed
+        def self.to_tc_bytes(rate)
+          return nil if rate.nil?
+          m = /^(\d+)(\w*)$/.match(rate)
+          raise ArgumentError if m.nil?
+          digits, units = m.captures
+          bits = case units.downcase
+            when 'kbps' then (8 * 1000) # kilobytes
+            when 'mbps' then (8 * 1000**2) # megabytes
+            when 'gbps' then (8 * 1000**3) # gigabytes
+            when 'kbit' then 1000 # kilobits
+            when 'mbit' then (1000**2) # megabits
+            when 'gbit' then (1000**3) # gigabits
+            when 'bps' then 8 # bytes
+            when 'bit', '' then 1 # bits
+            else nil
+          end
+          raise ArgumentError if bits.nil?
+          return (digits.to_i * bits / 8)
+        end
+
         def to_bytes
           Bandwidth.to_bytes(@rate)
         end
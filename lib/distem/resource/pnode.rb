@@ -50,6 +50,7 @@ module Distem
         @status = Status::INIT
         @algorithms = {}
         @algorithms[:cpu] = Algorithm::CPU::HOGS
+        @algorithms[:network] = Algorithm::Network::TC
 
         @@ids += 1
         @local_vifaces = 0
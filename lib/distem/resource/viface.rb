@@ -123,8 +123,10 @@ module Distem
       attr_accessor :vinput
       # The ifb device used by this viface
       attr_accessor :ifb
-      # Special rules that override all the virtual traffic
+      # Special rules that override all the virtual traffic (latency by destination)
       attr_accessor :latency_filters
+      # Special rules that override all the virtual traffic (bandwidth by destination, a rate at 'tc' form)
+      attr_accessor :bandwidth_filters
       # Bridge on with the viface is attached
       attr_accessor :bridge
       # Define if this interface is the vnode's default one
@@ -101,6 +101,14 @@ module Distem
         return fn
       end
 
+      def visit_integer(int) # :nodoc:
+        return int
+      end
+
+      def visit_float(float) # :nodoc:
+        return float
+      end
+
       # Visit an Hash object, call the "visit" method for each *values* in the Hash.
       # ==== Attributes
       # * +hash+ The Hash object
@@ -129,6 +129,44 @@ module LXCWrapper # :nodoc: all
       }
     end
 
+    #Get the directory of the container in the cgroup2 hierarchy (nil if not found)
+    #The layout depends on the LXC version (lxc.payload.<name> since LXC4)
+    def self.cgroup2_path(contname)
+      root = Distem::Node::Admin.cgroup2_path
+      return nil unless root
+      ["lxc.payload.#{contname}", "lxc.payload/#{contname}", "lxc/#{contname}"].each do |dir|
+        path = File.join(root,dir)
+        return path if File.directory?(path)
+      end
+      return nil
+    end
+
+    #Get the directory of the container in a cgroup1 hierarchy (nil if not found)
+    def self.cgroup1_path(contname, controller)
+      root = Distem::Node::Admin.cgroup1_path
+      return nil unless root
+      ["lxc.payload.#{contname}", "lxc.payload/#{contname}", "lxc/#{contname}"].each do |dir|
+        path = File.join(root,controller,dir)
+        return path if File.directory?(path)
+      end
+      return nil
+    end
+
+    #Get the pid of the init process of the container (nil if it is not running)
+    def self.pid(contname)
+      pid = Distem::Lib::Shell.run("lxc-info -n #{contname} -p -H",true).strip
+      return (pid.empty? ? nil : pid.to_i)
+    rescue Distem::Lib::ShellError
+      return nil
+    end
+
+    #Get the command line (Array) that runs a command in the namespaces and the cgroups of the container
+    def self.attach_cmd(contname, command)
+      return ['lxc-attach', '-n', contname, '--clear-env',
+        '-v', 'PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin',
+        '-v', 'HOME=/root', '--', '/bin/sh', '-c', command]
+    end
+
     def self.get_lxc_version()
       lxc_version = _command?('lxc-version')? `lxc-version`.split(":")[1].strip : `lxc-ls --version`.chop
       return lxc_version
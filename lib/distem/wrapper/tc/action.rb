@@ -4,6 +4,7 @@ module TCWrapper # :nodoc: all
     ADD="add"
     DEL="del"
     CHANGE="change"
+    REPLACE="replace"
   end
 
 end
@@ -0,0 +1,86 @@
+module TCWrapper # :nodoc: all
+
+  # Accumulates tc commands to run them with a single "tc -batch" process
+  class Batch
+    DELIMITER="TCBATCH"
+
+    attr_reader :cmds
+    # The pid of the process the network namespace of which the commands are
+    # run in (nil for the namespace of distem)
+    attr_reader :pid
+
+    def initialize(pid=nil)
+      @cmds = []
+      @pid = pid
+      @netns = {}
+      @hooks = []
+    end
+
+    # cmd is a complete tc command line (as returned by Wrapper#get_cmd)
+    def add(cmd)
+      @cmds << cmd.sub(/\A\s*#{Wrapper::CMDBIN}\s+/,'')
+      return self
+    end
+
+    alias_method :<<, :add
+
+    # The batch of the commands to run in the network namespace of the process
+    # pid (a container), committed along with this one
+    def netns(pid)
+      return self if pid.nil? || (pid == @pid)
+      @netns[pid] ||= Batch.new(pid)
+    end
+
+    # Run the block once the batch is committed (i.e. release a device the
+    # commands of which are still in the batch)
+    def after_commit(&block)
+      @hooks << block
+      return self
+    end
+
+    def empty?
+      @cmds.empty? && @netns.values.all? { |batch| batch.empty? }
+    end
+
+    def size
+      @cmds.size + @netns.values.inject(0) { |size,batch| size + batch.size }
+    end
+
+    # Run the accumulated commands and empty the batch (then the batches of
+    # the other network namespaces). tc stops on the first error (unless force
+    # is set), the ShellError then refers to the command(s) that failed instead
+    # of the whole batch
+    def commit(force=false)
+      out = run(force)
+      @netns.each_value { |batch| out += batch.commit(force) }
+      return out
+    ensure
+      hooks = @hooks
+      @hooks = []
+      hooks.each { |hook| hook.call }
+    end
+
+    protected
+
+    def run(force)
+      return "" if @cmds.empty?
+
+      cmds = @cmds
+      @cmds = []
+      prefix = (@pid ? "nsenter -t #{@pid} -n " : '')
+      begin
+        return Distem::Lib::Shell.run(
+          "#{prefix}#{Wrapper::CMDBIN} #{force ? '-force ' : ''}-batch - <<'#{DELIMITER}'\n" \
+          "#{cmds.join("\n")}\n#{DELIMITER}"
+        )
+      rescue Distem::Lib::ShellError => e
+        failed = e.err.scan(/^Command failed .*:(\d+)\s*$/).collect do |line|
+          "#{Wrapper::CMDBIN} #{cmds[line[0].to_i - 1]}"
+        end
+        raise if failed.empty?
+        raise Distem::Lib::ShellError.new(failed.join('; '),e.ret,e.err)
+      end
+    end
+  end
+
+end
@@ -0,0 +1,12 @@
+module TCWrapper # :nodoc: all
+
+
+  class ClassDRR < Class
+    TYPE="drr"
+
+    def initialize(iface,parent,params=Hash.new)
+      super(iface,parent,TYPE,params)
+    end
+  end
+
+end
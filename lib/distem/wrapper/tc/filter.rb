@@ -5,6 +5,7 @@ module TCWrapper # :nodoc: all
     WTYPE="filter"
 
     attr_reader :id, :parentid
+    attr_accessor :handle
 
     def initialize(iface,parent,dest,protocol,prio,type,params)
       super(iface,WTYPE,type,params)
@@ -13,10 +14,17 @@ module TCWrapper # :nodoc: all
       @protocol = protocol
       @prio = prio
       @filterparams = {}
+      @handle = nil
 
-      @id = Id.new(@parent.id.major,@parent.id.next_minor_id)
+      #A filter is not a class, it must not take a minor id from its parent:
+      #the minors of the classes would run out with the filters that are
+      #added and deleted when the latencies are updated
+      @id = Id.new(@parent.id.major)
       @parentid = @parent.id
-      if (@dest.kind_of? Qdisc)
+      #No dest for the filters that only set up or link hash tables
+      if (@dest.nil?)
+        @destid = nil
+      elsif (@dest.kind_of? Qdisc)
         @destid = @dest.parentid
       else
         @destid = @dest.id
@@ -28,8 +36,9 @@ module TCWrapper # :nodoc: all
         + ((@parent.kind_of? QdiscRoot) ? \
            "root" : "parent " + @parentid.to_s) \
            + " protocol " + @protocol + (@prio > 0 ? " prio " + @prio.to_s : "") \
-           + " " + @type + " " + get_filter_params + " flowid " + @destid.to_s \
-           + " " + get_params
+           + (@handle ? " handle " + @handle.to_s : "") \
+           + " " + @type + " " + get_filter_params \
+           + (@destid ? " flowid " + @destid.to_s : "") + " " + get_params
     end
 
     def get_filter_params
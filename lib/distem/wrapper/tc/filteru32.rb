@@ -5,6 +5,10 @@ module TCWrapper # :nodoc: all
     TYPE="u32"
 
     U32_MATCH="match"
+    U32_HT="ht"
+    U32_LINK="link"
+    U32_HASHKEY="hashkey"
+    U32_DIVISOR="divisor"
 
     U32T_U8="u8"
     U32T_U32="u32"
@@ -49,6 +53,28 @@ module TCWrapper # :nodoc: all
       add_filter_param(U32_MATCH,U32M_IP_SRC + " " + ip)
       return self
     end
+
+    #Makes the filter create the hash table handle (eg. "100:")
+    def set_hash_table(handle,divisor)
+      @handle = handle
+      add_filter_param(U32_DIVISOR,divisor)
+      return self
+    end
+
+    #The bucket of a hash table the filter is put in (eg. "100:2a:"), to be
+    #set before the match
+    def set_ht(ht)
+      add_filter_param(U32_HT,ht)
+      return self
+    end
+
+    #Jump to the hash table handle, in the bucket given by the 32 bits at
+    #offset masked with mask
+    def set_hash_link(handle,mask,offset)
+      add_filter_param(U32_HASHKEY,"mask " + mask + " at " + offset.to_s)
+      add_filter_param(U32_LINK,handle)
+      return self
+    end
   end
 
 end
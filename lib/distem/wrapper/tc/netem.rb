@@ -9,6 +9,10 @@ module TCWrapper # :nodoc: all
     attr_accessor :duplication
     attr_accessor :reordering
     attr_accessor :bandwidth
+    # parent class of the qdisc (root if nil)
+    attr_accessor :parent
+    # queue size in packets (default if nil)
+    attr_accessor :limit
 
     def initialize(action, iface)
       @action = action
@@ -19,12 +23,27 @@ module TCWrapper # :nodoc: all
       @duplication = nil
       @reordering = nil
       @bandwidth = nil
+      @parent = nil
+      @limit = nil
+    end
+
+    # true if no impairment is set
+    def empty?
+      !(@latency && @latency[:delay]) && !(@loss && @loss[:percent]) &&
+        !(@corruption && @corruption[:percent]) &&
+        !(@duplication && @duplication[:percent]) &&
+        !(@reordering && @reordering[:percent]) &&
+        !(@bandwidth && @bandwidth[:rate])
     end
 
 
     def get_cmd()
 
-      cmd = "tc qdisc #{@action} dev #{@iface} root netem"
+      cmd = "tc qdisc #{@action} dev #{@iface} #{@parent ? "parent #{@parent}" : 'root'} netem"
+
+      if @limit
+        cmd += " limit #{@limit}"
+      end
 
       if @latency && @latency[:delay]
         cmd +=  " delay #{@latency[:delay]} #{@latency[:jitter]}"
@@ -0,0 +1,20 @@
+module TCWrapper # :nodoc: all
+
+
+
+  class QdiscClsact < Wrapper
+    TYPE="qdisc"
+
+    attr_reader :id
+
+    def initialize(iface)
+      super(iface,TYPE,"clsact",Hash.new)
+      @id = Id.new("ffff")
+    end
+
+    def get_cmd(*args)
+      super(*args) + "clsact"
+    end
+  end
+
+end
@@ -0,0 +1,13 @@
+module TCWrapper # :nodoc: all
+
+
+
+  class QdiscDRR < Qdisc
+    TYPE="drr"
+
+    def initialize(iface,parent,params=Hash.new)
+      super(iface,parent,TYPE,params)
+    end
+  end
+
+end
@@ -0,0 +1,75 @@
+require 'spec_helper'
+
+describe Distem::Daemon::Broadcast do
+
+  # Targets 10.0.0.1 ... 10.0.0.n
+  def targets(n)
+    return (1..n).collect { |i| ["10.0.0.#{i}", nil] }
+  end
+
+  before :each do
+    @sent = []
+    @down = []
+    # A client of a pnode that answers for its whole subtree (unless it is down)
+    allow(Distem::NetAPI::Client).to receive(:new) { |address, port|
+      client = Object.new
+      sent, down = @sent, @down
+      client.define_singleton_method(:broadcast) { |method, args, target, subtree, digest, arity|
+        raise Distem::Lib::UnreachableResourceError, target if down.include?(target)
+        sent << [target, subtree.keys]
+        Hash[subtree.keys.collect { |t| [t, { 'status' => 'ok', 'result' => args }] }]
+      }
+      client
+    }
+  end
+
+  describe ".split" do
+    it "returns no subtree without targets" do
+      expect(Distem::Daemon::Broadcast.split([], 8)).to eq([])
+    end
+
+    it "gives every target its own subtree when there are at most arity targets" do
+      expect(Distem::Daemon::Broadcast.split(targets(3), 8)).to eq([
+        [['10.0.0.1', nil], []],
+        [['10.0.0.2', nil], []],
+        [['10.0.0.3', nil], []],
+      ])
+    end
+
+    it "splits the targets in at most arity subtrees of contiguous targets" do
+      subtrees = Distem::Daemon::Broadcast.split(targets(10), 3)
+      expect(subtrees.size).to eq(3)
+      expect(subtrees.collect { |root,descendants| root[0] }).to eq(['10.0.0.1', '10.0.0.5', '10.0.0.9'])
+      expect(subtrees.collect { |root,descendants| descendants.size }).to eq([3, 3, 1])
+      expect(subtrees.collect { |root,descendants| [root] + descendants }.flatten(1)).to eq(targets(10))
+    end
+  end
+
+  describe ".call" do
+    it "sends the call to the root of each subtree only" do
+      results = Distem::Daemon::Broadcast.call('set_global_etchosts', ['data'], Hash[targets(10)], nil, 3)
+      expect(@sent.collect { |root,subtree| root }).to include('10.0.0.1', '10.0.0.5', '10.0.0.9')
+      expect(@sent.size).to eq(3)
+      expect(results.keys.sort).to eq(targets(10).collect { |target| target[0] }.sort)
+      expect(Distem::Daemon::Broadcast.errors(results)).to eq({})
+    end
+
+    it "sends the subtree of a root that cannot be reached again without it" do
+      @down << '10.0.0.5'
+      results = Distem::Daemon::Broadcast.call('set_global_etchosts', ['data'], Hash[targets(10)], nil, 3)
+      expect(Distem::Daemon::Broadcast.errors(results).keys).to eq(['10.0.0.5'])
+      expect(results.keys.sort).to eq(targets(10).collect { |target| target[0] }.sort)
+      resent = @sent.collect { |root,subtree| subtree }.flatten
+      expect(resent).to include('10.0.0.6', '10.0.0.7', '10.0.0.8')
+      expect(resent).not_to include('10.0.0.5')
+    end
+
+    it "reports every target of a subtree the roots of which all fail" do
+      @down.concat(['10.0.0.1', '10.0.0.2', '10.0.0.3', '10.0.0.4'])
+      results = Distem::Daemon::Broadcast.call('set_global_etchosts', ['data'], Hash[targets(4)], nil, 1)
+      expect(Distem::Daemon::Broadcast.errors(results).keys.sort).to eq(['10.0.0.1', '10.0.0.2', '10.0.0.3', '10.0.0.4'])
+      expect(@sent).to eq([])
+    end
+  end
+
+end
@@ -0,0 +1,143 @@
+require 'spec_helper'
+
+describe Distem::Algorithm::Network::TBF do
+
+  # The tc commands of the batches committed since the last call (with their spaces squeezed)
+  def commands
+    cmds = @cmds.collect { |cmd| cmd.split.join(' ') }
+    @cmds = []
+    return cmds
+  end
+
+  # Apply the per destination latencies (and bandwidths) and return the tc commands
+  def apply(latencies, bandwidths = nil)
+    @viface.latency_filters = latencies
+    @viface.bandwidth_filters = bandwidths
+    @tbf.apply(@viface)
+    return commands
+  end
+
+  before :each do
+    @cmds = []
+    links = (0..15).collect { |i| { 'name' => "ifb#{i}" } }
+    nl = double('rtnetlink', :links => links, :link_set => nil, :qdiscs => [])
+    allow(Distem::Lib::NetTools).to receive(:rtnetlink) { |*args, &block| block.call(nl) }
+    allow(Distem::Node::Admin).to receive(:ifb?).and_return(true)
+    allow_any_instance_of(TCWrapper::Batch).to receive(:commit) { |batch| @cmds += batch.cmds; '' }
+    Distem::Algorithm::Network::TCAlgorithm.class_variable_set(:@@ifballocator, nil)
+
+    @tbf = Distem::Algorithm::Network::TBF.new
+    @viface = Distem::Resource::VIface.new('if0', 0, Distem::Resource::VNode.new('node1'))
+    @setup = apply({ '10.0.1.2' => 10, '10.0.1.3' => 10, '10.0.2.2' => 20 })
+  end
+
+  it "sets up the hash tables, a class per latency and a filter per host" do
+    expect(@setup).to eq([
+      'qdisc add dev node1-if0 ingress',
+      'filter add dev node1-if0 parent ffff: protocol ip u32 match u32 0 0 flowid root action mirred egress redirect dev ifb0',
+      'qdisc add dev ifb0 root handle 1: drr',
+      'class add dev ifb0 parent 1: classid 1:0x1 drr',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 100: u32 divisor 256',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 u32 ht 800:: match ip dst 0.0.0.0/0 hashkey mask 0x0000ff00 at 16 link 100:',
+      'class add dev ifb0 parent 1: classid 1:0x2 drr',
+      'qdisc add dev ifb0 parent 1:0x2 netem delay 10ms',
+      'class add dev ifb0 parent 1: classid 1:0x3 drr',
+      'qdisc add dev ifb0 parent 1:0x3 netem delay 20ms',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 101: u32 divisor 256',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 u32 ht 100:1: match u32 0 0 hashkey mask 0x000000ff at 16 link 101:',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 101:2:800 u32 ht 101:2: match ip dst 10.0.1.2 flowid 1:0x2',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 101:3:800 u32 ht 101:3: match ip dst 10.0.1.3 flowid 1:0x2',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 102: u32 divisor 256',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 u32 ht 100:2: match u32 0 0 hashkey mask 0x000000ff at 16 link 102:',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 102:2:800 u32 ht 102:2: match ip dst 10.0.2.2 flowid 1:0x3',
+      'filter add dev ifb0 parent 1: protocol all prio 3 u32 match u32 0 0 flowid 1:0x1',
+    ])
+  end
+
+  it "leaves the setup untouched when nothing changed" do
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10, '10.0.2.2' => 20 })).to eq([])
+  end
+
+  it "changes the filter of a host moved to another latency" do
+    expect(apply({ '10.0.1.2' => 20, '10.0.1.3' => 10, '10.0.2.2' => 20 })).to eq([
+      'filter change dev ifb0 parent 1: protocol ip prio 1 handle 101:2:800 u32 ht 101:2: match ip dst 10.0.1.2 flowid 1:0x3',
+    ])
+  end
+
+  it "changes the netem leaf of a class the latency of which is no longer used" do
+    expect(apply({ '10.0.1.2' => 30, '10.0.1.3' => 30, '10.0.2.2' => 20 })).to eq([
+      'qdisc change dev ifb0 parent 1:0x2 netem delay 30ms',
+    ])
+    expect(apply({ '10.0.1.2' => 40, '10.0.1.3' => 30, '10.0.2.2' => 20 })).to eq([
+      'class add dev ifb0 parent 1: classid 1:0x4 drr',
+      'qdisc add dev ifb0 parent 1:0x4 netem delay 40ms',
+      'filter change dev ifb0 parent 1: protocol ip prio 1 handle 101:2:800 u32 ht 101:2: match ip dst 10.0.1.2 flowid 1:0x4',
+    ])
+  end
+
+  it "deletes the filter of a removed host and reuses its node id" do
+    expect(apply({ '10.0.1.2' => 10, '10.0.2.2' => 20 })).to eq([
+      'filter del dev ifb0 parent 1: protocol ip prio 1 handle 101:3:800 u32',
+    ])
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 20, '10.0.2.2' => 20 })).to eq([
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 101:3:800 u32 ht 101:3: match ip dst 10.0.1.3 flowid 1:0x3',
+    ])
+  end
+
+  it "gives another node id to a host in a bucket already in use" do
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10, '10.0.2.2' => 20, '10.0.3.2' => 20 })).to eq([
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 103: u32 divisor 256',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 u32 ht 100:3: match u32 0 0 hashkey mask 0x000000ff at 16 link 103:',
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 103:2:800 u32 ht 103:2: match ip dst 10.0.3.2 flowid 1:0x3',
+    ])
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10, '10.0.2.2' => 20, '10.0.3.2' => 20, '10.1.1.2' => 20 })).to eq([
+      'filter add dev ifb0 parent 1: protocol ip prio 1 handle 101:2:801 u32 ht 101:2: match ip dst 10.1.1.2 flowid 1:0x3',
+    ])
+  end
+
+  it "deletes the classes no longer used after their filters and reuses their ids" do
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10 })).to eq([
+      'filter del dev ifb0 parent 1: protocol ip prio 1 handle 102:2:800 u32',
+      'class del dev ifb0 classid 1:0x3',
+    ])
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 50 })).to eq([
+      'class add dev ifb0 parent 1: classid 1:0x3 drr',
+      'qdisc add dev ifb0 parent 1:0x3 netem delay 50ms',
+      'filter change dev ifb0 parent 1: protocol ip prio 1 handle 101:3:800 u32 ht 101:3: match ip dst 10.0.1.3 flowid 1:0x3',
+    ])
+  end
+
+  it "gives its own class to a destination with a bandwidth" do
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10, '10.0.2.2' => 20 }, { '10.0.1.3' => '10mbit' })).to eq([
+      'class add dev ifb0 parent 1: classid 1:0x4 drr',
+      'qdisc add dev ifb0 parent 1:0x4 netem delay 10ms rate 10mbit',
+      'filter change dev ifb0 parent 1: protocol ip prio 1 handle 101:3:800 u32 ht 101:3: match ip dst 10.0.1.3 flowid 1:0x4',
+    ])
+  end
+
+  it "does not re-key a class without bandwidth to a class with a bandwidth" do
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10 }, { '10.0.2.2' => '1mbit' })).to eq([
+      'class add dev ifb0 parent 1: classid 1:0x4 drr',
+      'qdisc add dev ifb0 parent 1:0x4 netem delay 0ms rate 1mbit',
+      'filter change dev ifb0 parent 1: protocol ip prio 1 handle 102:2:800 u32 ht 102:2: match ip dst 10.0.2.2 flowid 1:0x4',
+      'class del dev ifb0 classid 1:0x3',
+    ])
+    expect(apply({ '10.0.1.2' => 10, '10.0.1.3' => 10 }, { '10.0.2.2' => '2mbit' })).to eq([
+      'qdisc change dev ifb0 parent 1:0x4 netem delay 0ms rate 2mbit',
+    ])
+  end
+
+  it "matches the networks after the hosts and sets everything up again when they change" do
+    cmds = apply({ '10.0.1.2' => 10, '10.0.3.0/24' => 30 })
+    expect(cmds[0...4]).to eq(@setup[0...4])
+    expect(cmds).to include(
+      'qdisc add dev ifb0 parent 1:0x3 netem delay 30ms',
+      'filter add dev ifb0 parent 1: protocol ip prio 2 u32 match ip dst 10.0.3.0/24 flowid 1:0x3'
+    )
+    expect(cmds.last).to eq('filter add dev ifb0 parent 1: protocol all prio 3 u32 match u32 0 0 flowid 1:0x1')
+    expect(apply({ '10.0.1.2' => 20, '10.0.3.0/24' => 30 })).to eq([
+      'qdisc change dev ifb0 parent 1:0x2 netem delay 20ms',
+    ])
+  end
+
+end
@@ -412,5 +412,14 @@ class ExperimentalTesting < MiniTest::Test
     }
   end
 
+  def test_16_set_peers_bandwidth
+    install_distem
+    puts "\n\n**** Running #{this_method} ****"
+    Net::SSH.start(@@coordinator, USER) { |session|
+      launch_vnodes(session, {'pf_kind' => '50nodes'})
+      check_result(session.exec!("ruby #{File.join(ROOT,'exps/exp-matrix-bandwidths.rb')}"))
+    }
+  end
+
 
 end
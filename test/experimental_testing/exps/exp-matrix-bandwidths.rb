@@ -0,0 +1,53 @@
+#!/usr/bin/ruby
+
+require 'distem'
+require File.join(File.dirname(__FILE__), 'stats')
+require File.join(File.dirname(__FILE__), 'helpers')
+
+REPETS = 3
+ERROR = 0.1
+
+def do_error
+  puts 'TEST NOT PASSED'
+  exit 1
+end
+
+puts '<<< Matrix bandwidths test >>>'
+
+nodes = (1..50).to_a.map { |i| "node#{i}" }
+latencies = (1..50).to_a.map { (1..50).to_a.map { 10 + rand(50) }}
+bands = (1..50).to_a.map { (1..50).to_a.map { 10 * (1 + rand(10)) }}  # this is in megabits/s
+random_nodes = []
+while random_nodes.length < 5 do
+  random_nodes << 1 + rand(50)
+  random_nodes = random_nodes.uniq
+end
+Distem.client do |cl|
+  cl.set_global_etchosts
+  cl.set_peers_latencies(nodes, latencies, bands.map { |row| row.map { |band| "#{band}mbit" }})
+end
+random_nodes.each { |i|
+  random_nodes.each { |j|
+    if (i != j)
+      `distem --execute vnode=node#{i},command="killall -KILL iperf"`
+      nums = Stats.new
+      Open3.popen3("distem --execute vnode=node#{i},command=\"iperf -s -y c -P #{REPETS}\"") do |si,o,e,w|
+        sleep 1  # wait 1 second for iperf-server to start
+        REPETS.times {
+          `distem --execute vnode=node#{j},command="iperf -t 10 -y c -c node#{i}"`
+        }
+        o.read.each_line do |l|
+          nums.push(l.split(',').last.to_f / 1e6)
+        end
+      end
+      band = bands[j-1][i-1]
+      if (nums.mean > ((1 + ERROR) * band)) || (nums.mean < ((1 - ERROR) * band))
+        puts "ERROR: requested #{band}mbits, measured #{nums.mean}mbits"
+        do_error
+      else
+        puts "OK: requested #{band}mbits, measured #{nums.mean}mbits"
+      end
+    end
+  }
+}
+puts 'TEST PASSED'